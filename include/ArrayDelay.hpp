@@ -0,0 +1,163 @@
+//
+//  ArrayDelay.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef ArrayDelay_hpp
+#define ArrayDelay_hpp
+
+#include <vector>
+#include <atomic>
+#include "RingBuffer.hpp"
+
+namespace laproque {
+
+/**
+ * @class ArrayDelay
+ * @brief Delay module with one input and many outputs, e.g. for driving a loudspeaker array.
+ *
+ * The input is written once. Every tap reads it with its own delay and adds it to one or more
+ * output channels with individual gains. Either every tap drives one output (set_taps), or the
+ * gains form a tap to output matrix (set_matrix), of which only the non-zero entries are processed.
+ * Blocks are read contiguously from the history and accumulated with SSE.
+ * Several sources can share the same outputs with process_add.
+ *
+ * The setters build a new tap table and hand it to the processing thread without locking or
+ * allocating there, so they may be called from one control thread during playback.
+ * A delay changed with set_delay moves to its new value with at most one sample per sample,
+ * read with cubic interpolation. Taps replaced with set_taps or set_matrix start at their delays.
+ */
+class ArrayDelay
+{
+public:
+    /**
+     * @param n_outputs Number of output channels.
+     * @param max_delay Maximum samples of possible delay.
+     * @param max_block Number of frames processed in one step of block processing.
+     */
+    ArrayDelay( unsigned n_outputs, unsigned max_delay=16384, unsigned max_block=1024 );
+    
+    /**
+     * @brief Function for block processing. Overwrites the outputs.
+     * @param input Buffer with input audio samples.
+     * @param outputs Buffers with output audio samples. First dimension n_outputs, second dimension n_frames.
+     * @param n_frames Number of audio frames to be processed.
+     */
+    void process( float* input, float** outputs, unsigned long n_frames );
+    
+    /**
+     * @brief Function for block processing. Adds to the signals in the outputs.
+     * @param input Buffer with input audio samples.
+     * @param outputs Buffers with output audio samples. First dimension n_outputs, second dimension n_frames.
+     * @param n_frames Number of audio frames to be processed.
+     */
+    void process_add( float* input, float** outputs, unsigned long n_frames );
+    
+    /**
+     * @brief Replace all taps by one tap per output.
+     * Tap i drives output i. Delays > max_delay are clipped.
+     * @param delays Array with n_taps delay values in samples.
+     * @param gains Array with n_taps gain factors.
+     * @param n_taps Number of taps. At most n_outputs.
+     */
+    void set_taps( unsigned long* delays, float* gains, unsigned n_taps );
+    
+    /**
+     * @brief Replace all taps by taps feeding the outputs through a gain matrix.
+     * Delays > max_delay are clipped.
+     * @param delays Array with n_taps delay values in samples.
+     * @param gains Array with n_taps * n_outputs gain factors, the gains of tap 0 to all outputs first.
+     * @param n_taps Number of taps.
+     */
+    void set_matrix( unsigned long* delays, float* gains, unsigned n_taps );
+    
+    /**
+     * @brief Change the delay of one tap. The tap moves to the new delay gradually.
+     * Moves from or to delays below 2 samples are applied immediately.
+     * @param tap Index of the tap.
+     * @param delay Delay in samples. Only applied if <= max_delay.
+     */
+    void set_delay( unsigned tap, unsigned long delay );
+    
+    /**
+     * @brief Change the gain a tap drives one output with.
+     * A new route from the tap to the output is created if the gain was 0.
+     * @param tap Index of the tap.
+     * @param output Index of the output channel.
+     * @param gain Gain factor.
+     */
+    void set_gain( unsigned tap, unsigned output, float gain );
+    
+    /** @brief Erase internal buffer. Keeps the taps. */
+    void reset();
+    
+    /** @returns Number of output channels. */
+    unsigned get_n_outputs();
+    
+    /** @returns Number of taps. */
+    unsigned get_n_taps();
+    
+private:
+    /** Connection of one tap to one output. */
+    struct _Route
+    {
+        unsigned tap;
+        unsigned output;
+        float gain;
+    };
+    
+    RingBuffer _ring;
+    unsigned _n_outputs;
+    unsigned long _max_delay;
+    unsigned long _max_block;
+    
+    /** Taps and routes as set by the control thread. */
+    struct _Taps
+    {
+        std::vector< unsigned long > delays;
+        
+        /** All non-zero connections, ordered by tap. */
+        std::vector< _Route > routes;
+        
+        /** Changes with set_taps and set_matrix. Delays only move gradually within one layout. */
+        unsigned long layout = 0;
+        
+        /** n_taps values, swapped with _current_delays by the processing thread. */
+        std::vector< float > current;
+    };
+    
+    /**
+     * Triple buffer passing tap tables to the processing thread.
+     * The control thread fills _sets[_back_set], the processing thread reads _sets[_front_set].
+     */
+    _Taps _sets[3];
+    unsigned _back_set = 0;
+    unsigned _front_set = 1;
+    std::atomic<unsigned> _latest_set{2};
+    
+    /** Set in _latest_set if the latest set has not been applied yet. */
+    static const unsigned NEW_SET = 4;
+    
+    /** Last set handed over by the control thread. Base for changing single taps. */
+    unsigned _published_set = 2;
+    
+    /** Delays the processing currently reads with. Owned by the processing thread. */
+    std::vector< float > _current_delays;
+    
+    /** One block of a tap with a moving delay. */
+    std::vector< float > _moving;
+    
+    /** Copy the published set to the back set, so single values can be changed. */
+    _Taps& _edit_set();
+    
+    void _publish_set();
+    
+    void _process( float* input, float** outputs, unsigned long n_frames, bool add );
+};
+
+} // namespace laproque
+
+#endif /* ArrayDelay_hpp */
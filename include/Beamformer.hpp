@@ -0,0 +1,118 @@
+//
+//  Beamformer.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef Beamformer_hpp
+#define Beamformer_hpp
+
+#include <vector>
+#include <atomic>
+#include "RingBuffer.hpp"
+
+namespace laproque {
+
+/**
+ * @class Beamformer
+ * @brief Delay-and-sum beamformer with many inputs and many beams.
+ *
+ * Every input is stored once. Each beam is the sum of all inputs, read with individual fractional
+ * delays and weighted. The inputs are read with cubic Hermite interpolation, four frames at once with SSE.
+ * Steering values can be set from a control thread while another thread processes. They are passed
+ * through a triple buffer without locking and applied at the start of the next process call, where every
+ * delay and weight moves linearly to its new value within the block.
+ */
+class Beamformer
+{
+public:
+    /**
+     * @param n_inputs Number of input channels, e.g. microphones.
+     * @param n_beams Number of output beams.
+     * @param max_delay Maximum samples of possible delay.
+     * @param max_block Number of frames processed in one step of block processing.
+     */
+    Beamformer( unsigned n_inputs, unsigned n_beams, unsigned max_delay=4096, unsigned max_block=1024 );
+    ~Beamformer();
+    
+    /**
+     * @brief Function for block processing.
+     * @param inputs Buffers with input audio samples. First dimension n_inputs, second dimension n_frames.
+     * @param beams Buffers with output audio samples. First dimension n_beams, second dimension n_frames.
+     * @param n_frames Number of audio frames to be processed.
+     */
+    void process( float** inputs, float** beams, unsigned long n_frames );
+    
+    /**
+     * @brief Steer one beam. Can be called from another thread than process.
+     * Delays are clipped to 2 to max_delay - 2 samples. Changes by more than one
+     * sample per sample are spread over several process calls.
+     * @param beam Index of the beam.
+     * @param delays Array with n_inputs fractional delays in samples.
+     * @param weights Array with n_inputs gain factors.
+     */
+    void set_steering( unsigned beam, float* delays, float* weights );
+    
+    /**
+     * @brief Steer all beams at once. Can be called from another thread than process.
+     * @param delays Array with n_beams * n_inputs fractional delays, the delays of beam 0 first.
+     * @param weights Array with n_beams * n_inputs gain factors, the weights of beam 0 first.
+     */
+    void set_all_steering( float* delays, float* weights );
+    
+    /** @brief Erase internal buffers. */
+    void reset();
+    
+    /** @returns Number of input channels. */
+    unsigned get_n_inputs();
+    
+    /** @returns Number of beams. */
+    unsigned get_n_beams();
+    
+private:
+    unsigned _n_inputs;
+    unsigned _n_beams;
+    unsigned _max_block;
+    float _max_delay;
+    
+    /** History of every input. */
+    std::vector< RingBuffer* > _histories;
+    
+    /** Delays and weights of all beams, n_inputs values per beam. */
+    struct _Steering
+    {
+        std::vector< float > delays;
+        std::vector< float > weights;
+    };
+    
+    /** Values the processing currently uses. */
+    _Steering _current;
+    
+    /** Values the processing moves to in the current call. */
+    _Steering _target;
+    
+    /**
+     * Triple buffer passing steering values to the processing thread.
+     * The control thread fills _sets[_back_set], the processing thread reads _sets[_front_set].
+     */
+    _Steering _sets[3];
+    unsigned _back_set = 0;
+    unsigned _front_set = 1;
+    std::atomic<unsigned> _latest_set{2};
+    
+    /** Set in _latest_set if the latest set has not been applied yet. */
+    static const unsigned NEW_SET = 4;
+    
+    /** Last set handed over by the control thread. Base for steering single beams. */
+    unsigned _published_set = 2;
+    
+    void _publish_set();
+    
+    float _clip_delay( float delay );
+};
+
+} // namespace laproque
+
+#endif /* Beamformer_hpp */
@@ -35,8 +35,9 @@ public:
      * @param imp_resp Pointer to the impulse response you want to use.
      * @param n_samples Length of the impulse response in samples.
      * @param block_size Size of the processing blocks i.e. partitions.
+     * @param planner_flags FFTW planner flags. FFTW_ESTIMATE plans quickly without measuring.
      */
-    Convolver(float* imp_resp, unsigned long n_samples, unsigned block_size);
+    Convolver(float* imp_resp, unsigned long n_samples, unsigned block_size, unsigned planner_flags = FFTW_MEASURE);
     
     /**
      * Copy constructor.
@@ -61,6 +62,13 @@ public:
      */
     void set_freq_response( fftwf_complex* new_response );
     
+    /**
+     * @brief Replace the impulse response without planning new transforms.
+     * @param imp_resp Pointer to the new impulse response.
+     * @param n_samples Length of the impulse response. At most get_n_parts() * get_block_size(), shorter responses are zero padded.
+     */
+    void set_imp_response( float* imp_resp, unsigned long n_samples );
+    
     /**
      * @brief Set time domain input buffer to 0.
      *
@@ -68,6 +76,27 @@ public:
      */
     void reset_input_buffer();
     
+    /**
+     * @brief Replace the stored input signal.
+     *
+     * Brings the Convolver to the state it would have after processing the history block by block. Useful when the signal feeding the Convolver is switched.
+     * @param history The last get_n_parts() * get_block_size() input samples, oldest first.
+     */
+    void set_input_history( float* history );
+    
+    /**
+     * @brief Copy the stored input signal without transforming it again.
+     * @param spectra Receives get_spectra_size() complex values.
+     * @param last_input Receives get_block_size() samples.
+     */
+    void get_input_state( fftwf_complex* spectra, float* last_input );
+    
+    /**
+     * @brief Replace the stored input signal by one taken with get_input_state().
+     * The state must come from a Convolver with the same block size and number of partitions.
+     */
+    void set_input_state( fftwf_complex* spectra, float* last_input );
+    
     /**
      * @brief Returns FFT resolution.
      */
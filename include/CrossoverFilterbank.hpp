@@ -0,0 +1,147 @@
+//
+//  CrossoverFilterbank.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef CrossoverFilterbank_hpp
+#define CrossoverFilterbank_hpp
+
+#include <vector>
+
+namespace laproque {
+
+/**
+ * This enum specifies the slope of the crossovers in the CrossoverFilterbank class.
+ */
+enum crossover_type
+{
+    /** 24 dB per octave, two second order Butterworth sections per band edge. */
+    LR4,
+    /** 48 dB per octave, two fourth order Butterworth filters per band edge. */
+    LR8
+};
+
+/**
+ * @class CrossoverFilterbank
+ * @brief One channel Linkwitz-Riley filter bank built from biquads.
+ *
+ * Splits the signal like Filterbank, highest crossover first, with steeper Linkwitz-Riley slopes.
+ * Low and high pass of a crossover add up to an allpass. With compensation, every band also passes the
+ * allpasses of the crossovers below it, so all bands sum to the same allpass and the magnitude of the sum is flat.
+ *
+ * All biquads are in transposed direct form II and are processed side by side in SSE lanes.
+ * A section runs one sample behind the section feeding it, so all sections of one step are independent.
+ * The bands are written back at their own sample positions, which adds no latency.
+ */
+class CrossoverFilterbank
+{
+public:
+    /**
+     * @param co_freqs Crossover frequencies splitting the bands, in ascending order.
+     * @param sample_rate Audio sample frequency the filter bank operates with.
+     * @param type Slope of the crossovers.
+     * @param compensate If true, allpasses are added so the bands sum flat.
+     */
+    CrossoverFilterbank( std::vector<float> co_freqs = std::vector<float>{1000.f}
+                        , unsigned sample_rate = 44100
+                        , crossover_type type = LR4
+                        , bool compensate = true
+                        );
+    
+    /**
+     * @brief Operator for processing one sample.
+     * @param in_sample Input value of audio signal.
+     * @param bands Pointer to buffer into which all bands are written. Must hold n_bands values.
+     */
+    void operator()( float in_sample, float* bands );
+    
+    /**
+     * @brief Function for block processing.
+     * @param input Pointer to buffer with input signal.
+     * @param output Pointer to buffers with band signals. First dimension n_bands, second dimension n_frames.
+     * @param n_frames Number of audio frames to be processed.
+     */
+    void process( float* input, float** output, unsigned long n_frames );
+    
+    /**
+     * @brief Set new crossover frequency values.
+     * @param co_freqs New crossover frequencies. Only applied if the number of values is unchanged.
+     */
+    void set_co_freqs( std::vector<float> co_freqs );
+    
+    /**
+     * @brief Change operating sampling frequency.
+     * @param sample_rate New desired value for sampling frequency.
+     */
+    void set_sample_rate( unsigned sample_rate );
+    
+    /** @brief Set all delay lines to 0. */
+    void reset();
+    
+    /** @returns Number of bands. */
+    unsigned get_n_bands();
+    
+    /** @returns Number of biquad sections. */
+    unsigned get_n_sections();
+    
+private:
+    std::vector<float> _crossover_freqs;
+    unsigned _sample_rate;
+    crossover_type _type;
+    
+    unsigned _n_bands;
+    unsigned _n_sections;
+    
+    /** Number of groups of four sections. */
+    unsigned _n_groups;
+    
+    /** This enum specifies the response of one section. */
+    enum _response { _LOW, _HIGH, _ALL };
+    
+    /** Design of one section, used to compute its coefficients. */
+    struct _Design
+    {
+        unsigned crossover;
+        _response response;
+        float q;
+    };
+    std::vector< _Design > _designs;
+    
+    /** Section feeding every section. Index _n_groups * 4 stands for the input. */
+    std::vector< unsigned > _sources;
+    
+    /** Number of sections between the input and every section, i.e. samples it runs behind. */
+    std::vector< float > _depths;
+    unsigned _max_depth;
+    
+    /** Section whose output is a band. Index _n_groups * 4 stands for the input. */
+    std::vector< unsigned > _band_sections;
+    
+    /** Coefficients b0, b1, b2, a1, a2 of four sections each, group by group. */
+    std::vector< float > _coeffs;
+    
+    /** States s1 and s2 of four sections each, group by group. */
+    std::vector< float > _states;
+    
+    /**
+     * Two sets of the outputs of all sections, each followed by the input sample of its step.
+     * One holds the last step, the other receives the current step.
+     */
+    std::vector< float > _outputs;
+    
+    /** Band pointers for sample wise processing. */
+    std::vector< float* > _band_ptrs;
+    
+    /** @brief Adds a section fed by source. @returns Index of the new section. */
+    unsigned _add_section( unsigned source, unsigned crossover, _response response, float q );
+    
+    /** @brief Computes the coefficients of all sections. */
+    void _update_coeffs();
+};
+
+} // namespace laproque
+
+#endif /* CrossoverFilterbank_hpp */
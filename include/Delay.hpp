@@ -10,6 +10,7 @@
 #define Delay_hpp
 
 #include <stddef.h>
+#include "RingBuffer.hpp"
 
 namespace laproque {
 
@@ -23,8 +24,10 @@ public:
     /** 
      * @param n_delay Number of samples the signal gets delayed.
      * @param max_delay Maximum samples of possible delay i.e. internal buffer size.
+     * @param pool Shared page storage for the internal buffer. If nullptr, the buffer is allocated at once.
+     * @param format Storage format of the internal buffer. The 16 bit formats halve memory and bandwidth.
      */
-    Delay( unsigned n_delay=0, unsigned max_delay=16384 );
+    Delay( unsigned n_delay=0, unsigned max_delay=16384, PagePool* pool=nullptr, sample_format format=FLOAT32 );
     virtual ~Delay();
     
     /**
@@ -45,6 +48,19 @@ public:
      * Works with abitrary number of samples as long as there is enough input.
      */
     virtual void process( float* input, float* output, unsigned long n_samples );
+    
+    /**
+     * @brief Access the stored input signal in place, without copying.
+     *
+     * Returns the block of n_frames frames whose last frame was written delay frames before the most
+     * recent input sample, in at most two contiguous pieces. Only available with the FLOAT32 format.
+     * @param delay Delay of the last frame of the block in samples.
+     * @param n_frames Number of frames of the block.
+     * @param spans Array of two pointers receiving the start of each piece.
+     * @param lengths Array of two values receiving the number of frames of each piece.
+     * @returns Number of pieces, 1 or 2. 0 if the block is not stored or can not be accessed in place.
+     */
+    unsigned get_spans( unsigned long delay, unsigned long n_frames, const float** spans, unsigned long* lengths );
 
     /** @returns One sample without writing to the internal buffer. */
     float get_one();
@@ -71,13 +87,10 @@ public:
     void replace_buffer( float* sample_data, unsigned n_frames );
     
 protected:
-    /** Pointer to the position in the buffer where the process reads. */
-    float* _reader;
-    
-    /** Pointer to one sample after the buffer memory. */
-    float* _buffer_end;
+    /** Audio sample storage */
+    RingBuffer _ring;
     
-    /** Number of samples which can be sotred in _buffer */
+    /** Maximum number of samples delay i.e. size of the accessible history. */
     long int _buffer_size;
     
     /** Number of samples which remain to be written to the output. Used in process */
@@ -86,14 +99,8 @@ protected:
     /** Number of samples of delay that is currently set */
     ptrdiff_t _n_delay;
     
-    /** Audio sample storage */
-    float* _buffer;
-    
-    /** Number of samples ready to be written to the output without further steps. */
+    /** Number of samples processed in one step of process. */
     ptrdiff_t _n_ready;
-    
-    /** Pointer to the position in the buffer where the process writes. */
-    float* _writer;
 
 };
 
@@ -0,0 +1,159 @@
+//
+//  FDN.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef FDN_hpp
+#define FDN_hpp
+
+#include <vector>
+
+namespace laproque {
+
+/**
+ * This enum specifies the feedback matrix of the FDN class.
+ */
+enum mixing_matrix
+{
+    HADAMARD,
+    HOUSEHOLDER
+};
+
+/**
+ * @class FDN
+ * @brief Feedback delay network reverberator. One input and one output channel.
+ *
+ * The outputs of all delay lines are damped, mixed by an orthogonal matrix and fed back
+ * together with the input signal. The Hadamard matrix is applied with the fast Walsh-Hadamard transform
+ * in O(N log N), the Householder reflection in O(N).
+ * Every line has its own history, exactly as long as its delay. Processing runs in blocks no longer
+ * than the shortest line, so each line is read and written as one contiguous block. Within a block,
+ * line states and coefficients are stored as arrays over the lines and every step runs on four lines
+ * at once with SSE, so the number of lines is always a multiple of four.
+ */
+class FDN
+{
+public:
+    /**
+     * @param n_lines Number of delay lines, 8 to 64. Rounded up to a multiple of four, or to a power of two for the Hadamard matrix.
+     * @param max_delay Maximum samples of delay of one line. The default line lengths are shortened to fit.
+     * If max_delay is too short for get_n_lines() distinct prime lengths, the lines get longer instead.
+     * @param sample_rate Audio sample frequency the FDN operates with.
+     * @param mixing Feedback matrix.
+     */
+    FDN( unsigned n_lines = 32,
+         unsigned max_delay = 8192,
+         unsigned sample_rate = 44100,
+         mixing_matrix mixing = HADAMARD
+        );
+    
+    /**
+     * @brief Function for block processing.
+     * @param input Buffer with input audio samples.
+     * @param output Buffer with output audio samples.
+     * @param n_frames Number of audio frames to be processed.
+     */
+    void process( float* input, float* output, unsigned long n_frames );
+    
+    /**
+     * @brief Set the lengths of all delay lines.
+     * Values are clipped to the range 1 to max_delay. Resizes and erases the delay lines and applies
+     * the reverberation time again.
+     * @param delays Array with get_n_lines() delay values in samples.
+     */
+    void set_delays( unsigned long* delays );
+    
+    /**
+     * @brief Set the reverberation time.
+     *
+     * Every line gets a first order shelving filter built from a low and a high pass Filter,
+     * whose gains make the signal decay by 60 dB within the given times.
+     * @param rt60_low Reverberation time in seconds below the crossover frequency.
+     * @param rt60_high Reverberation time in seconds above the crossover frequency.
+     * @param crossover_freq Transition frequency of the damping filters.
+     */
+    void set_rt60( float rt60_low, float rt60_high, float crossover_freq = 4000.f );
+    
+    /**
+     * @brief Set the gains the input is fed into the lines with.
+     * @param gains Array with get_n_lines() gain factors.
+     */
+    void set_input_gains( float* gains );
+    
+    /**
+     * @brief Set the gains the line outputs are summed with.
+     * @param gains Array with get_n_lines() gain factors.
+     */
+    void set_output_gains( float* gains );
+    
+    /**
+     * @brief Erase the delay lines and filter states.
+     */
+    void reset();
+    
+    /** @returns Number of delay lines. */
+    unsigned get_n_lines();
+    
+    /** @returns Current length of one delay line in samples. */
+    unsigned long get_delay( unsigned line );
+    
+private:
+    /** Number of delay lines. */
+    unsigned _n_lines;
+    
+    /** Longest possible line. */
+    unsigned long _max_delay;
+    
+    /** Frames processed in one step. At most BLOCK and the shortest line. */
+    unsigned long _block_size;
+    
+    static const unsigned long BLOCK = 64;
+    
+    unsigned _sample_rate;
+    mixing_matrix _mixing;
+    
+    float _rt60_low = 2.f;
+    float _rt60_high = 1.f;
+    float _crossover_freq = 4000.f;
+    
+    /** Histories of all lines one after another. Line i starts at _offsets[i] and holds _delays[i] samples. */
+    std::vector< float > _history;
+    std::vector< unsigned long > _offsets;
+    
+    /** Position in each line history the next block is read from and written to. */
+    std::vector< unsigned long > _positions;
+    
+    /** Line delays in samples. */
+    std::vector< unsigned long > _delays;
+    
+    /** Damping filter coefficients per line. */
+    std::vector< float > _b0, _b1, _a1;
+    
+    /** Damping filter states per line. */
+    std::vector< float > _in_state, _out_state;
+    
+    std::vector< float > _in_gains;
+    std::vector< float > _out_gains;
+    
+    /** One block of every line, line after line with BLOCK samples each. */
+    std::vector< float > _line_block;
+    
+    /** The same block frame after frame with _n_lines samples each. */
+    std::vector< float > _frames;
+    
+    /** @brief Place the line histories one after another and erase them. */
+    void _allocate_lines();
+    
+    /** @brief Apply the feedback matrix to the _n_lines values of one frame. */
+    void _mix( float* frame );
+    
+    /** @brief Compute the damping filter coefficients from the delays and reverberation times. */
+    void _compute_coeffs();
+};
+
+} // namespace laproque
+
+#endif /* FDN_hpp */
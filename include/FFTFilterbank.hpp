@@ -0,0 +1,131 @@
+//
+//  FFTFilterbank.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.
+//
+
+#ifndef FFTFilterbank_hpp
+#define FFTFilterbank_hpp
+
+#include <vector>
+#include "FFThelper.hpp"
+
+namespace laproque {
+
+/**
+ * @class FFTFilterbank
+ * @brief One channel filter bank computed with short time Fourier transforms.
+ *
+ * The input is cut into frames of fft_size samples with a hop of fft_size / 4, windowed with the
+ * square root of a Hann window and transformed. Every bin is assigned to the band its center frequency
+ * falls into. A bin right at a crossover is shared by both bands, so the weights of all bands add up
+ * to one in every bin and the sum of all bands equals the delayed input.
+ *
+ * process_mix() applies the band gains to the spectrum and needs one inverse transform per frame,
+ * whatever the number of bands. process() returns every band like Filterbank::process() and needs one
+ * inverse transform per band. The frequency resolution is sample_rate / fft_size, so bands narrower
+ * than a few bins need a larger fft_size.
+ */
+class FFTFilterbank
+{
+public:
+    /**
+     * @param co_freqs Ascending crossover frequencies splitting the bands.
+     * @param sample_rate Audio sample frequency the filter bank operates with.
+     * @param fft_size Frame length in samples. Must be a multiple of 4.
+     */
+    FFTFilterbank(
+                  std::vector<float> co_freqs = std::vector<float>{1000.f}
+                  , unsigned sample_rate = 44100
+                  , unsigned fft_size = 1024
+                  );
+
+    ~FFTFilterbank();
+
+    /**
+     * @brief Function for block processing. All bands are delayed by get_latency() samples.
+     * @param input Pointer to buffer with input signal.
+     * @param output Pointer to buffer with band signals.
+     * Must hold: First dimension get_n_bands(), second dimension n_frames.
+     */
+    void process( float* input, float** output, unsigned long n_frames );
+
+    /**
+     * @brief Function for block processing of the weighted sum of all bands.
+     * The sum is delayed by get_latency() samples. Do not mix with process() on one instance.
+     * @param input Pointer to buffer with input signal.
+     * @param output Pointer to buffer with output signal.
+     * @param n_frames Number of audio frames to be processed.
+     */
+    void process_mix( float* input, float* output, unsigned long n_frames );
+
+    /**
+     * @brief Set the gain factors of the bands used by process_mix(). All are 1 initially.
+     * @param weights One gain factor per band. Ignored if the number does not match.
+     */
+    void set_band_weights( std::vector<float> weights );
+
+    /**
+     * @brief Set new crossover frequency values.
+     * @param co_freqs Must have the same length as on initialization.
+     */
+    void set_co_freqs( std::vector<float> co_freqs );
+
+    /** @brief Erase the input and overlap buffers. */
+    void reset();
+
+    /** @returns Number of bands in the filter bank. */
+    unsigned get_n_bands();
+
+    /** @returns Delay of all outputs in samples. */
+    unsigned long get_latency();
+
+private:
+    std::vector<float> _crossover_freqs;
+    unsigned _sample_rate;
+    unsigned _n_bands;
+
+    unsigned _fft_size;
+    unsigned _hop_size;
+    unsigned _spectrum_size;
+    FFThelper _fft;
+
+    /** Square root of a periodic Hann window, used for analysis and synthesis. */
+    std::vector<float> _window;
+
+    /** Weight of every bin in every band. Only bins first_bin to last_bin - 1 can be nonzero. */
+    std::vector< std::vector<float> > _masks;
+    std::vector<unsigned> _first_bins;
+    std::vector<unsigned> _last_bins;
+    /** Gain of every bin for process_mix(). */
+    std::vector<float> _bin_gains;
+    std::vector<float> _band_weights;
+
+    /** The last fft_size input samples. */
+    std::vector<float> _input;
+    /** Number of samples of the current hop already received. */
+    unsigned _hop_fill;
+
+    float* _frame;
+    fftwf_complex* _spectrum;
+    fftwf_complex* _band_spectrum;
+
+    /** Overlap-add buffer of every band. The first hop_size samples are complete. */
+    std::vector< std::vector<float> > _band_overlaps;
+    /** Overlap-add buffer of process_mix(). */
+    std::vector<float> _mix_overlap;
+
+    void _update_masks();
+    void _update_gains();
+
+    /** Transforms the current frame into _spectrum. */
+    void _analyse();
+    /** Transforms a spectrum back and adds it to an overlap-add buffer. */
+    void _synthesise( fftwf_complex* spectrum, std::vector<float>& overlap );
+};
+
+} // namespace laproque
+
+#endif /* FFTFilterbank_hpp */
@@ -24,8 +24,9 @@ class FFThelper
 public:
     /**
      * @param size FFT size / resolution.
+     * @param planner_flags FFTW planner flags. FFTW_ESTIMATE plans quickly without measuring.
      */
-    FFThelper( unsigned size );
+    FFThelper( unsigned size, unsigned planner_flags = FFTW_MEASURE );
     ~FFThelper();
     
     /**
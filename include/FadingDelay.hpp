@@ -39,7 +39,11 @@ private:
     
     unsigned long _to_fade;
     
-    float* _old_reader;
+    /** Delay value which is applied in the next process call. */
+    long _next_delay;
+    
+    /** Delay value which is faded out. */
+    long _old_delay;
     
     float* _fadein_buf;
     float* _fadeout_buf;
@@ -10,10 +10,11 @@
 #define FadingMultiDelay_hpp
 
 #include <vector>
-#include <array>
 #include <sndfile.h>
 #include <stddef.h>
 #include <atomic>
+#include "RingBuffer.hpp"
+#include "WorkerPool.hpp"
 
 namespace laproque {
 
@@ -27,8 +28,12 @@ class FadingMultiDelay
 public:
     /** 
      @param max_delay Maximum samples of possible delay i.e. internal buffer size.
+     @param max_n_delays Maximum number of delay values set at once. All tap storage is allocated here.
+     @param n_threads Number of threads the taps are split across in process, including the calling thread.
+     @param pool Shared page storage for the internal buffer. If nullptr, the buffer is allocated at once.
+     @param format Storage format of the internal buffer. The 16 bit formats halve memory and bandwidth.
      */
-    FadingMultiDelay( unsigned max_delay=16384 );
+    FadingMultiDelay( unsigned max_delay=16384, unsigned max_n_delays=1000, unsigned n_threads=1, PagePool* pool=nullptr, sample_format format=FLOAT32 );
     virtual ~FadingMultiDelay();
     
     
@@ -42,14 +47,19 @@ public:
     
     /**
      * @brief Replace currently set delay values.
-     * Must contain same number of values as currently set. Only values smaller
-     * than max_delay are applied.
+     * The new values are compared with the ones currently played at the start of the
+     * next process call. Only delays that changed are crossfaded, the others keep playing.
+     * If a previous call has not been applied yet, it is superseded by this one.
+     * Only values smaller than max_delay are applied.
      * @param delays Array with new desired delay values.
+     * @param weights Array with gain factors for the delays.
+     * @param n_values Number of values in delays and weights.
      */
     void set_delays( unsigned long* delays, float* weights, unsigned n_values );
     
     /**
      * @brief Replace gain factors of all delays currently set.
+     * The gains are ramped without crossfading between two readers.
      * @param new_weights Array with gain factors.
      */
     void set_weights( float* new_weights );
@@ -62,6 +72,19 @@ public:
      */
     void process( float* input, float* output, unsigned long n_frames );
     
+    /**
+     * @brief Access the stored input signal in place, without copying.
+     *
+     * Returns the block of n_frames frames whose last frame was written delay frames before the most
+     * recent input sample, in at most two contiguous pieces. Only available with the FLOAT32 format.
+     * @param delay Delay of the last frame of the block in samples.
+     * @param n_frames Number of frames of the block.
+     * @param spans Array of two pointers receiving the start of each piece.
+     * @param lengths Array of two values receiving the number of frames of each piece.
+     * @returns Number of pieces, 1 or 2. 0 if the block is not stored or can not be accessed in place.
+     */
+    unsigned get_spans( unsigned long delay, unsigned long n_frames, const float** spans, unsigned long* lengths );
+    
     /**
      * @brief Erase internal buffer.
      * Also resets the writer and all reader pointers. Keeps the delay values.
@@ -98,82 +121,116 @@ public:
     
     unsigned get_n_delays();
     
-    static const unsigned N_DELAYS_MAX = 1000;
+    /** @returns Maximum number of delay values set at once. */
+    unsigned get_max_n_delays();
     
     void kill_last();
     
 private:
     
-    /** Array which stores the input audio samples. */
-    float* _buffer;
+    /** Stores the input audio samples. */
+    RingBuffer _ring;
     
-    /** Pointer to sample after last _buffer value. */
-    float* _buffer_end;
+    /** Maximum number of delays */
+    const unsigned _max_n_delays;
     
-    /** Array which stores the outputs of the internal processing objects */
-    float* _core_buffer;
+    /** Maximum number of taps. Usually a delay has at most one dying tap besides its current one. */
+    const unsigned _max_n_taps;
     
-    /** Pointer to place in _buffer where input is currently to. */
-    float* _writer;
-        
     /** Number of delays currently set */
     unsigned _n_delays = 0;
     
-    unsigned _new_n_delays = 0;
+    /** Set of delay values passed to set_delays or set_weights. */
+    struct _DelaySet
+    {
+        std::vector< unsigned long > delays;
+        std::vector< float > weights;
+        unsigned n_delays = 0;
+    };
+    
+    /**
+     * Triple buffer passing delay sets from the control to the audio thread.
+     * The control thread fills the back set, the audio thread reads the front set
+     * and the latest set is exchanged between them.
+     */
+    _DelaySet _sets[3];
+    unsigned _back_set = 0;
+    unsigned _front_set = 1;
+    std::atomic<unsigned> _latest_set{2};
+    
+    /** Set in _latest_set if the latest set has not been applied yet. */
+    static const unsigned NEW_SET = 4;
     
-    std::array< unsigned long, N_DELAYS_MAX > _new_delays;
-    std::array< float, N_DELAYS_MAX > _new_weights;
+    /** Index of the last set published by the control thread. */
+    unsigned _published_set = 2;
+    bool _has_published = false;
     
-    void _update();
+    /** True if the front set could not be applied completely. */
+    bool _update_pending = false;
     
-    /** Shortest delay value */
-    unsigned long _min_delay;
+    /** @brief Hand the back set over to the audio thread. */
+    void _publish_set();
+    
+    /** @brief Apply the differences between the latest set and the playing taps. */
+    void _update();
     
     unsigned long _n_remaining, _n_ready;
     
-    void _update_min_delay();
+    /** Marks a delay without tap or a tap without delay. */
+    static const unsigned NO_TAP = ~0u;
+    
+    /**
+     * Taps which are currently read, densely packed. During a fade the gain of a tap is
+     * _tap_old_weights * fade_out + _tap_weights * fade_in, afterwards _tap_weights.
+     */
+    unsigned _n_taps = 0;
+    std::vector< unsigned long > _tap_delays;
+    std::vector< float > _tap_weights;
+    std::vector< float > _tap_old_weights;
+    std::vector< unsigned long > _tap_to_fade;
+    std::vector< FadeBehavior > _tap_status;
+    
+    /** Delay index each tap belongs to. NO_TAP for dying taps. */
+    std::vector< unsigned > _tap_owners;
     
-    std::atomic<bool> _has_changed{false};
+    /** Tap index of every delay. */
+    std::vector< unsigned > _delay_taps;
     
-    class _DelayCore
-    {
-    public:
-        
-        _DelayCore( float* buf, float* buf_end, unsigned long n_delay, float** writer );
-        _DelayCore();
-        _DelayCore( const _DelayCore &obj);
-        
-        _DelayCore & operator= ( const _DelayCore & );
-        
-        void process( float* output, unsigned long n_samples );
-        
-        void set_delay( unsigned long delay, float weight );
-        void set_status( FadeBehavior status );
-        
-        unsigned long get_delay();
-        FadeBehavior get_status();
-        
-    private:
-        float* _buf;
-        float* _buf_end;
-        long _buf_size;
-        
-        float** _wtr;
-        float* _rdr;
-        float* _old_rdr;
-        
-        float _wgt;
-        float _old_wgt;
-        
-        unsigned long _n_dly;
-        unsigned long _to_fade = 0;
-        FadeBehavior _status = BORN;
-        
-        unsigned long processed = 0;
-        
-    };
+    /** @brief Append a tap which fades in and assign it to delay index dly. */
+    void _add_tap( unsigned dly, unsigned long delay, float weight );
+    
+    /** @brief Ramp the gain of a tap from its current value to weight. */
+    void _ramp_tap( unsigned tap, float weight );
+    
+    /** @brief Start fading out a tap from its current gain. */
+    void _kill_tap( unsigned tap );
+    
+    /** @brief Accumulate taps begin to end-1 of the current block into output. */
+    void _process_taps( unsigned begin, unsigned end, float* output );
+    
+    /** @brief WorkerPool job processing one part of the taps. */
+    static void _process_part( void* instance, unsigned part );
+    
+    /** Threads processing the taps in parallel. nullptr if single threaded. */
+    WorkerPool* _pool = nullptr;
+    
+    /** Minimum number of taps per thread worth the synchronization. */
+    static const unsigned MIN_TAPS_PER_PART = 128;
+    
+    /** Number of parts the taps are split into in the current block. */
+    unsigned _n_parts = 1;
+    
+    /** Output of the first part. */
+    float* _part_output;
+    
+    /** Outputs of the other parts, one block each. */
+    std::vector< float > _partials;
+    
+    /** @brief Remove dead taps and close the gaps. */
+    void _remove_dead_taps();
     
-    std::array<_DelayCore, N_DELAYS_MAX> _delays;
+    /** @returns Gain of a tap at the current position of its fade. */
+    float _get_tap_gain( unsigned tap );
     
 };
 
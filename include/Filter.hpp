@@ -93,6 +93,52 @@ public:
      */
     void reverse();
     
+    /**
+     * @brief Copy the current filter coefficients.
+     *
+     * The Filter computes \f$ y[n] = b_0 x[n] + b_1 x[n-1] - a_1 y[n-1] \f$.
+     * Can be used to run the same filter in other processing structures.
+     * @param b_coeffs Array of two elements receiving the non-recursive coefficients.
+     * @param a_coeffs Array of two elements receiving the recursive coefficients. a_coeffs[0] is always 1.
+     */
+    void get_coeffs( float* b_coeffs, float* a_coeffs );
+    
+    /**
+     * @brief Choose how process evaluates the recursion.
+     *
+     * In scan mode, the block is split into the non-recursive part, which is vectorized, and the recursion
+     * \f$ y[n] = u[n] - a_1 y[n-1] \f$, which is solved as a prefix sum over 16 samples at a time. Only the
+     * last output of each 16 samples is passed on serially, so long blocks are processed several times faster.
+     * The results differ from the serial recursion only by rounding.
+     * @param enabled True for scan mode, false for the serial recursion, which is the default.
+     */
+    void set_parallel_scan( bool enabled );
+    
+    /**
+     * @brief Block processing with one cutoff frequency per sample.
+     *
+     * The coefficients of every sample are computed without tanf from a rational approximation of the
+     * tangent, four samples at once. They stay within float rounding of set_cutoff_freq(). Frequencies are
+     * clipped to just above 0 and just below half the sample rate, which keeps the filter stable.
+     * Afterwards the Filter keeps the cutoff frequency of the last sample.
+     * @param input Pointer to buffer with input signal.
+     * @param output Pointer to buffer with output signal.
+     * @param cutoff_freqs Pointer to buffer with one -3 dB cutoff frequency per sample.
+     * @param n_frames Number of audio frames to be processed.
+     */
+    void process_modulated( float* input, float* output, float* cutoff_freqs, unsigned long long n_frames );
+    
+    /**
+     * @brief Block processing while the cutoff frequency moves to a new value.
+     *
+     * The coefficients are interpolated linearly from the current ones to the ones of end_freq, reached
+     * with the last sample. Every interpolated coefficient set is a stable filter.
+     * @param input Pointer to buffer with input signal.
+     * @param output Pointer to buffer with output signal.
+     * @param end_freq -3 dB cutoff frequency at the end of the block.
+     * @param n_frames Number of audio frames to be processed.
+     */
+    void process_sweep( float* input, float* output, float end_freq, unsigned long long n_frames );
     
 private:
     /** Stores if filter instance is low or high pass. */
@@ -113,6 +159,11 @@ private:
     float _in_dlyline_backup = 0.f;
     /** Used to backup delay line state in order to be able to reset filter status. */
     float _out_dlyline_backup = 0.f;
+    /** True if process uses the parallel scan. */
+    bool _parallel_scan = false;
+    
+    /** @brief Block processing with the parallel scan. Needs at least 2 frames. */
+    void _process_scan( float* input, float* output, unsigned long long n_frames );
     
     /**
      * @brief Calculates the filter coefficients with the current cutoff frequency and sample frequency values.
@@ -125,6 +176,15 @@ private:
      * \f[ c = \frac{1}{tan\left( \pi * \frac{f_c}{f_s} \right) } \f]
      */
     void _compute_coeffs();
+    
+    /**
+     * @brief Sets the coefficients from the low pass gain \f$ k = b_0 = \frac{1}{1+c} \f$.
+     * The high pass has \f$ b_0 = 1-k \f$ and both have \f$ a_1 = 2k-1 \f$.
+     */
+    void _set_gain( float gain );
+    
+    /** @brief Block processing with one low pass gain per sample. */
+    void _process_gains( float* input, float* output, float* gains, unsigned long long n_frames );
 
 };
 
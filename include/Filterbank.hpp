@@ -53,6 +53,18 @@ public:
      */
     virtual void process( float* input, float** output, unsigned long n_frames );
     
+    /**
+     * @brief Block processing while the crossover frequencies move to new values.
+     *
+     * Every crossover moves linearly in frequency from its current to its new value, which is reached with
+     * the last sample. The filters use Filter::process_sweep(), so no tangent is evaluated per sample.
+     * @param input Pointer to buffer with input signal.
+     * @param output Pointer to buffer with band signals.
+     * @param end_freqs Crossover frequencies at the end of the block. Ignored if the number does not match.
+     * @param n_frames Number of audio frames to be processed.
+     */
+    void process_sweep( float* input, float** output, const std::vector<float>& end_freqs, unsigned long n_frames );
+    
     /**
      * @brief Set new crossover frequency values.
      * @param co_freqs New crossover frequency values.
@@ -96,6 +108,8 @@ private:
     std::vector<Filter> _filters;
     /** Stores all crossover frequency values */
     std::vector<float> _crossover_freqs;
+    /** Crossover frequencies at the start of process_sweep(). Sized with _crossover_freqs, so sweeping never allocates. */
+    std::vector<float> _start_freqs;
     /** Stores the sampling freuqency the flilterbank is curently operating with. */
     unsigned _sample_rate;
     
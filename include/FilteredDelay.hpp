@@ -18,6 +18,12 @@ namespace laproque {
 /**
  @class FilteredDelay
  @brief Delay unit with Filterbank and weighted sum of bands.
+ 
+ The low and high pass of each crossover sum to the input, so the weighted sum of all bands equals
+ one filter of the order of the number of crossovers. In collapsed mode this filter is used instead:
+ \f[ y = w_{K} x + \sum_{k<K} (w_k - w_{k+1}) t_k \f]
+ where \f$ t_k \f$ is the input after the low passes of crossovers k to K-1. Every sample then passes
+ K low pass sections instead of 2K filters and the band mix.
  */
 class FilteredDelay : public Delay
 {
@@ -27,12 +33,14 @@ public:
      @param max_delay Maximum number of possible frames delay = buffer size.
      @param co_freqs Crossover frequencies in the filterbank.
      @param sample_rate sample rate the internal filterbank workes with.
+     @param collapsed If true, the filterbank and band weights are replaced by one equivalent filter.
      */
     FilteredDelay(
                   unsigned n_delay=1
                   , unsigned max_delay=16384
                   , std::vector<float> co_freqs = std::vector<float>{200, 1e3}
                   , unsigned sample_rate = 44100
+                  , bool collapsed = false
                   );
     
     ~FilteredDelay();
@@ -90,6 +98,28 @@ private:
     unsigned long _n_remaining;
     
     const unsigned _intern_buff_size = 1024;
+    
+    /** True if the equivalent filter is used instead of the Filterbank. */
+    bool _collapsed;
+    std::vector< float > _co_freqs;
+    unsigned _sample_rate;
+    
+    /** Coefficients of the low pass sections of the equivalent filter, highest crossover first. */
+    std::vector< float > _section_b;
+    std::vector< float > _section_a;
+    /** Gain of the output of every section. */
+    std::vector< float > _section_gains;
+    /** Gain of the unfiltered input. */
+    float _direct_gain;
+    /** Last input of the equivalent filter, followed by the last output of every section. */
+    std::vector< float > _section_states;
+    
+    /** Computes the section coefficients from the crossover frequencies. */
+    void _update_sections();
+    /** Computes the section gains from the band weights. */
+    void _update_gains();
+    /** Runs n_frames samples through the equivalent filter. */
+    void _process_collapsed( float* input, float* output, unsigned long n_frames );
 };
 
 } //namespace laproque
@@ -19,11 +19,22 @@ namespace laproque {
 /**
  * @class FilteredMultiDelay
  * @brief Processing unit which works like MultiDelay with a Filterbank and weighted sum of bands before output.
+ *
+ * In band domain mode the band signals themselves are delayed. Every delay then has its own
+ * band weights, which costs one multiply-add per band and delay instead of one filterbank per delay.
+ * The sample wise functions of MultiDelay are not available in this mode.
  */
 class FilteredMultiDelay : public MultiDelay
 {
 public:
-    FilteredMultiDelay( unsigned n_bands = 3, unsigned sample_rate = 44100, unsigned block_size = 1024, unsigned max_delay = 45643 );
+    /**
+     * @param n_bands Number of frequency bands.
+     * @param sample_rate Audio sample frequency.
+     * @param block_size Maximum number of frames processed at once.
+     * @param max_delay Maximum samples of possible delay.
+     * @param band_domain If true, one buffer per band is stored so every delay can be weighted per band.
+     */
+    FilteredMultiDelay( unsigned n_bands = 3, unsigned sample_rate = 44100, unsigned block_size = 1024, unsigned max_delay = 45643, bool band_domain = false );
     virtual ~FilteredMultiDelay();
     
     /**
@@ -53,6 +64,18 @@ public:
      */
     void set_band_weights( std::vector<float> new_band_weights );
     
+    /**
+     * @brief Change the band weighting factors of one delay. Only used in band domain mode.
+     * The weights are applied in addition to the global band weights and the weight of the delay.
+     * @param delay_idx Index of the delay in the order the delays were added.
+     * @param new_band_weights Array with one weighting factor per band.
+     */
+    void set_tap_band_weights( unsigned delay_idx, float* new_band_weights );
+    
+    void add_delay( long delay, float weight );
+    void clear_delays();
+    void reset();
+    
     /**
      * @brief Change the sample rate the Unit is working with.
      * @param sample_rate The new sample rate value.
@@ -81,6 +104,20 @@ private:
     float* _internal_buffer;
     
     float* _band_weights;
+    
+    /** Stores the band signals instead of the input in band domain mode. */
+    bool _band_domain;
+    
+    /** History of every band. Only used in band domain mode. */
+    std::vector< RingBuffer* > _band_rings;
+    
+    /** Band weights of all delays, _n_bands values per delay. */
+    std::vector< float > _tap_band_weights;
+    
+    /** Gains of all bands of one delay for the current block. */
+    std::vector< float > _tap_gains;
+    
+    void _process_bands( float* input, float* output, unsigned long n_frames );
 };
 
 } // namespace laproque
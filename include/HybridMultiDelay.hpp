@@ -0,0 +1,141 @@
+//
+//  HybridMultiDelay.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef HybridMultiDelay_hpp
+#define HybridMultiDelay_hpp
+
+#include <vector>
+#include <atomic>
+#include "MultiDelay.hpp"
+#include "Convolver.hpp"
+
+namespace laproque {
+
+/**
+ * @class HybridMultiDelay
+ * @brief MultiDelay which processes a dense cluster of delays with fast convolution.
+ *
+ * Many delays within a short time span form a sparse FIR filter. Whenever the delays
+ * change, the span of delays is searched for which partitioned convolution is cheaper
+ * than reading every delay on its own. The delays in that span are combined to one
+ * impulse response and processed by a Convolver, all other delays are processed like in MultiDelay.
+ *
+ * The split and the Convolver are prepared by the thread calling the setters and handed over to
+ * process() through a triple buffer, as in FadingMultiDelay. Changing only the weights reuses the
+ * Convolver of the split and recomputes its frequency response.
+ *
+ * Delays added with add_delay() take effect with the next call of commit() or set_delays(),
+ * so many delays can be added before the split is searched once.
+ */
+class HybridMultiDelay : public MultiDelay
+{
+public:
+    /**
+     * @param block_size Number of frames the Convolver processes at once. At most 1024.
+     * @param max_delay Maximum samples of possible delay i.e. internal buffer size.
+     */
+    HybridMultiDelay( unsigned block_size, unsigned max_delay=16384 );
+    ~HybridMultiDelay();
+    
+    /**
+     * @brief Function for block processing.
+     * @param input Buffer with input audio samples.
+     * @param output Buffer with output audio samples.
+     * @param n_frames Number of audio frames to be processed. Must be a multiple of block_size.
+     */
+    void process( float* input, float* output, unsigned long n_frames );
+    
+    /**
+     * @brief Choose a new split including the delays added since the last call and hand it to process().
+     * Until then, added delays are not played.
+     */
+    void commit();
+    
+    void set_delays( long* new_delays );
+    
+    /** @brief Replace the gain factors. Keeps the split and the Convolver of the last commit. */
+    void set_weights( float* new_weights );
+    
+    void clear_delays();
+    
+    /** @returns Number of delays currently processed by fast convolution. */
+    unsigned get_n_dense();
+    
+    /** @returns Estimated number of multiply-adds per block when processing every delay directly. */
+    float get_direct_cost();
+    
+    /** @returns Estimated number of multiply-adds per block with the current split. */
+    float get_hybrid_cost();
+    
+private:
+    /** Number of frames the Convolver processes at once. */
+    unsigned _block_size;
+    
+    /** Everything process() needs of one split. */
+    struct _Split
+    {
+        /** Processes the dense delays. nullptr if all delays are processed directly. Owned by the split. */
+        Convolver* convolver = nullptr;
+        /** Shortest delay in the dense span, i.e. delay of the Convolver input. */
+        long dense_offset = 0;
+        /** Delays and weights which are processed directly. */
+        std::vector< unsigned long > sparse_delays;
+        std::vector< float > sparse_weights;
+    };
+    
+    /**
+     * Triple buffer passing splits from the control to the audio thread.
+     * The control thread fills the back split, the audio thread reads the front split
+     * and the latest split is exchanged between them.
+     */
+    _Split _splits[3];
+    unsigned _back_split = 0;
+    unsigned _front_split = 1;
+    std::atomic<unsigned> _latest_split{2};
+    
+    /** Set in _latest_split if the latest split has not been applied yet. */
+    static const unsigned NEW_SPLIT = 4;
+    
+    /** Delay indices sorted by delay value, as of the last search. */
+    std::vector< unsigned > _order;
+    /** Dense span of the last search, as positions in _order. */
+    unsigned _first_dense = 0;
+    unsigned _last_dense = 0;
+    
+    /** Number of delays in the dense span. */
+    unsigned _n_dense = 0;
+    
+    float _direct_cost = 0.f;
+    float _hybrid_cost = 0.f;
+    
+    std::vector< float > _conv_input;
+    std::vector< float > _conv_output;
+    
+    /** Input state of the playing Convolver, taken before the front split is handed back. */
+    std::vector< float > _state_input;
+    fftwf_complex* _state_spectra;
+    
+    /** Signal history loaded into a Convolver whose input changed. */
+    std::vector< float > _history;
+    
+    /** @returns Estimated number of multiply-adds per block for a Convolver with an impulse response of n_samples. */
+    float _conv_cost( long n_samples );
+    
+    /** @brief Search the dense span and publish a split for it. */
+    void _split();
+    
+    /** @brief Fill the back split for the dense span of the last search and hand it to process(). */
+    void _publish();
+    
+    /** @brief Switch to the latest split and carry the Convolver input over. Runs in the audio thread. */
+    void _update();
+};
+
+} // namespace laproque
+
+#endif /* HybridMultiDelay_hpp */
@@ -14,18 +14,29 @@
 #include <vector>
 #include <atomic>
 #include <random>
+#include <thread>
 #include <sndfile.h>
 #include "JackPlugin.hpp"
+#include "SampleFifo.hpp"
 
 namespace laproque {
 
 /**
  @class Plays single-channel wav files in Jack Audio Connection Kit.
+ 
+ By default every file is decoded completely when it is added to the playlist. In streaming mode
+ add_file() only checks the file. A reader thread decodes the selected track ahead of the playhead
+ into a SampleFifo, and render_audio() only takes samples out of it. If the reader falls behind,
+ the missing samples are played as silence and counted as an underrun instead of waiting.
  */
 class JackPlayer : public JackPlugin
 {
 public:
-    JackPlayer();
+    /**
+     @param streaming If true, tracks are read from disk during playback instead of on add_file().
+     @param prefetch_size Number of frames the reader thread decodes ahead in streaming mode.
+     */
+    JackPlayer( bool streaming = false, unsigned long prefetch_size = 131072 );
     ~JackPlayer();
     void render_audio(nframes_t n_frames, sample_t **in_buffers, sample_t **out_buffers);
     
@@ -78,6 +89,12 @@ public:
     bool get_shuffle();
     unsigned get_n_tracks();
     
+    /** @returns True if tracks are read from disk during playback. */
+    bool get_streaming();
+    
+    /** @returns Number of processing blocks which lacked samples because the reader thread fell behind. */
+    unsigned long get_n_underruns();
+    
     void print_status();
     
 private:
@@ -111,6 +128,45 @@ private:
     void _read_audio( std::string file_path );
     
     void _jump( int n_files );
+    
+    bool _streaming;
+    
+    /** Decoded samples of the current track, from the reader to the audio thread. nullptr if not streaming. */
+    SampleFifo* _fifo = nullptr;
+    
+    std::thread _reader;
+    std::atomic<bool> _quit{ false };
+    
+    /** Guards _playlist against add_file() while the reader thread looks up a path. */
+    std::atomic_flag _playlist_lock = ATOMIC_FLAG_INIT;
+    
+    /**
+     * Track the reader thread has to stream from its start. Request count in the upper, track index in the lower 32 bits,
+     * so selecting the same track again is a new request as well.
+     */
+    std::atomic<unsigned long long> _request{ 0 };
+    /** Last request the reader thread has started to serve. */
+    std::atomic<unsigned long long> _served{ 0 };
+    /** FIFO write positions of the first and behind the last sample of the served track. */
+    std::atomic<unsigned long long> _track_start{ 0 };
+    std::atomic<unsigned long long> _track_end{ 0 };
+    
+    std::atomic<unsigned long> _n_underruns{ 0 };
+    
+    /** Maximum number of frames the reader thread decodes at once. */
+    const unsigned long _stream_chunk = 4096;
+    
+    /** @brief Ask the reader thread to stream a track from its start. */
+    void _request_track( unsigned idx );
+    
+    /** @brief Take up to n_frames samples of the selected track out of the FIFO. */
+    sf_count_t _read_stream( float* output, sf_count_t n_frames );
+    
+    /** @returns True if the audio thread has played the selected track up to its end. */
+    bool _stream_ended();
+    
+    /** Loop of the reader thread. */
+    void _stream_audio();
 };
 
 } // namespace laproque
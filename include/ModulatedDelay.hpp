@@ -0,0 +1,108 @@
+//
+//  ModulatedDelay.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef ModulatedDelay_hpp
+#define ModulatedDelay_hpp
+
+#include <vector>
+#include "RingBuffer.hpp"
+
+namespace laproque {
+
+/**
+ * @class ModulatedDelay
+ * @brief One channel delay module with continuously varying fractional delays.
+ *
+ * New delay and weight values are targets which are reached at the end of the next process call.
+ * In between, every tap moves linearly from its current to its target value, so the reader
+ * advances at a variable rate like for a moving source. The delayed signal is read with cubic
+ * Hermite interpolation, four frames at once with SSE.
+ * The delay of a tap changes by at most one sample per sample, i.e. the reading rate stays
+ * between 0 and 2. Larger changes are spread over several process calls.
+ */
+class ModulatedDelay
+{
+public:
+    /**
+     * @param max_delay Maximum samples of possible delay.
+     * @param max_n_taps Maximum number of taps.
+     * @param max_block Number of frames processed in one step of block processing.
+     */
+    ModulatedDelay( unsigned max_delay=16384, unsigned max_n_taps=256, unsigned max_block=1024 );
+    
+    /**
+     * @brief Function for block processing. The output is the sum of all taps.
+     * @param input Buffer with input audio samples.
+     * @param output Buffer with output audio samples.
+     * @param n_frames Number of audio frames to be processed.
+     */
+    void process( float* input, float* output, unsigned long n_frames );
+    
+    /**
+     * @brief Add a tap which starts at the given values without moving.
+     * Not added if max_n_taps taps exist already.
+     * @param delay Delay in samples. Clipped to 2 to max_delay - 2.
+     * @param weight Gain factor of the tap.
+     */
+    void add_tap( float delay, float weight );
+    
+    /**
+     * @brief Set target values of one tap.
+     * @param tap Index of the tap in the order the taps were added.
+     * @param delay Delay in samples to be reached at the end of the next process call.
+     * @param weight Gain factor to be reached at the end of the next process call.
+     */
+    void set_tap( unsigned tap, float delay, float weight );
+    
+    /**
+     * @brief Set target delays of all taps.
+     * @param delays Array with get_n_taps() delays in samples.
+     */
+    void set_delays( float* delays );
+    
+    /**
+     * @brief Set target gain factors of all taps.
+     * @param weights Array with get_n_taps() gain factors.
+     */
+    void set_weights( float* weights );
+    
+    /** @brief Remove all taps. */
+    void clear_taps();
+    
+    /** @brief Erase internal buffer. Keeps the taps. */
+    void reset();
+    
+    /** @returns Number of taps. */
+    unsigned get_n_taps();
+    
+    /** @returns Current delay of a tap in samples. */
+    float get_delay( unsigned tap );
+    
+private:
+    RingBuffer _ring;
+    
+    /** Maximum number of frames processed in one step. */
+    unsigned _max_block;
+    
+    float _max_delay;
+    unsigned _max_n_taps;
+    unsigned _n_taps = 0;
+    
+    std::vector< float > _delays;
+    std::vector< float > _target_delays;
+    /** Delays reached at the end of the current process call. */
+    std::vector< float > _end_delays;
+    std::vector< float > _weights;
+    std::vector< float > _target_weights;
+    
+    float _clip_delay( float delay );
+};
+
+} // namespace laproque
+
+#endif /* ModulatedDelay_hpp */
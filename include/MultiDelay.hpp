@@ -12,6 +12,7 @@
 #include <vector>
 #include <sndfile.h>
 #include <stddef.h>
+#include "RingBuffer.hpp"
 
 namespace laproque {
 
@@ -23,8 +24,13 @@ namespace laproque {
 class MultiDelay
 {
 public:
-    /** @param max_delay Maximum samples of possible delay i.e. internal buffer size. */
-    MultiDelay( unsigned max_delay=16384 );
+    /**
+     * @param max_delay Maximum samples of possible delay i.e. internal buffer size.
+     * @param max_block Number of frames processed in one step of block processing.
+     * @param pool Shared page storage for the internal buffer. If nullptr, the buffer is allocated at once.
+     * @param format Storage format of the internal buffer. The 16 bit formats halve memory and bandwidth.
+     */
+    MultiDelay( unsigned max_delay=16384, unsigned max_block=1024, PagePool* pool=nullptr, sample_format format=FLOAT32 );
     virtual ~MultiDelay();
     
     /**
@@ -40,7 +46,7 @@ public:
      * @param delay Desired number of samples delay.
      * @param weight Gain factor for the delay to be set.
      */
-    void add_delay( long delay, float weight );
+    virtual void add_delay( long delay, float weight );
     
     /**
      * @brief Replace currently set delay values.
@@ -48,13 +54,13 @@ public:
      * than max_delay are applied. 
      * @param new_delays Array with new desired delay values.
      */
-    void set_delays( long* new_delays );
+    virtual void set_delays( long* new_delays );
     
     /**
      * @brief Replace gain factors of all delays currently set.
      * @param new_weights Array with gain factors.
      */
-    void set_weights( float* new_weights );
+    virtual void set_weights( float* new_weights );
     
     /**
      * @brief Function for block processing.
@@ -64,6 +70,19 @@ public:
      */
     virtual void process( float* input, float* output, unsigned long n_frames );
     
+    /**
+     * @brief Access the stored input signal in place, without copying.
+     *
+     * Returns the block of n_frames frames whose last frame was written delay frames before the most
+     * recent input sample, in at most two contiguous pieces. Only available with the FLOAT32 format.
+     * @param delay Delay of the last frame of the block in samples.
+     * @param n_frames Number of frames of the block.
+     * @param spans Array of two pointers receiving the start of each piece.
+     * @param lengths Array of two values receiving the number of frames of each piece.
+     * @returns Number of pieces, 1 or 2. 0 if the block is not stored or can not be accessed in place.
+     */
+    unsigned get_spans( unsigned long delay, unsigned long n_frames, const float** spans, unsigned long* lengths );
+    
     
     void get_one( float* output );
     
@@ -73,13 +92,13 @@ public:
      * @brief Erase internal buffer.
      * Also resets the writer and all reader pointers. Keeps the delay values.
      */
-    void reset();
+    virtual void reset();
     
     /**
      * @brief Remove all delay values in this instance.
      * This clears all the delay values while retaining the buffered audio.
      */
-    void clear_delays();
+    virtual void clear_delays();
     
     /** 
      * @brief Replace part of the internal buffer.
@@ -97,14 +116,8 @@ public:
     std::vector< float* > get_delays();
     
 protected:
-    /** Array which stores the input audio samples. */
-    float* _buffer;
-    /** Pointer sample after last _buffer value. */
-    float* _buffer_end;
-    /** Pointer to place in _buffer where input is currently to. */
-    float* _writer;
-    /** Vector with pointers to the value in _buffer which is read next. */
-    std::vector< float* > _readers;
+    /** Stores the input audio samples. */
+    RingBuffer _ring;
     
     /** Vector with number of samples delay */
     std::vector< long > _n_samples_delay;
@@ -113,8 +126,8 @@ protected:
     /** Number of delays currently set */
     unsigned _n_delays = 0;
     
-    long _n_remaining, _n_ready_read, _n_ready_write;
-    /** Number of storeable audio sampls. */
+    long _n_remaining, _n_ready;
+    /** Maximum number of samples delay. */
     ptrdiff_t _buffer_size;
     
 };
@@ -0,0 +1,99 @@
+//
+//  MultichannelDelay.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef MultichannelDelay_hpp
+#define MultichannelDelay_hpp
+
+#include <vector>
+
+namespace laproque {
+
+/**
+ * @class MultichannelDelay
+ * @brief Bank of independent single delays, one per channel, sharing one buffer.
+ *
+ * Works like one Delay per channel. The channels are stored interleaved in groups of four,
+ * with one write position for all of them. Every channel only has its own read offset.
+ * A frame of a group is written with one SSE store, and the four channels of a group are read
+ * together into one vector. The start of the buffer is mirrored behind its end, so blocks never wrap.
+ */
+class MultichannelDelay
+{
+public:
+    /**
+     * @param n_channels Number of channels.
+     * @param max_delay Maximum samples of possible delay.
+     * @param max_block Number of frames processed in one step of block processing.
+     */
+    MultichannelDelay( unsigned n_channels, unsigned max_delay=16384, unsigned max_block=1024 );
+    
+    /**
+     * @brief Function for block processing.
+     * @param input Buffers with input audio samples. First dimension n_channels, second dimension n_frames.
+     * @param output Buffers with output audio samples. First dimension n_channels, second dimension n_frames.
+     * @param n_frames Number of audio frames to be processed.
+     */
+    void process( float** input, float** output, unsigned long n_frames );
+    
+    /**
+     * @brief Set the delay of one channel.
+     * @param channel Index of the channel.
+     * @param delay Desired number of samples delay. Only applied if <= max_delay.
+     */
+    void set_delay( unsigned channel, unsigned long delay );
+    
+    /**
+     * @brief Set the delays of all channels.
+     * @param delays Array with n_channels delay values. Values > max_delay are not applied.
+     */
+    void set_delays( unsigned long* delays );
+    
+    /** @brief Set all samples to 0. Keeps the delay values. */
+    void reset();
+    
+    /** @returns Number of channels. */
+    unsigned get_n_channels();
+    
+    /** @returns Delay of one channel in samples. */
+    unsigned long get_delay( unsigned channel );
+    
+private:
+    unsigned _n_channels;
+    
+    /** Number of groups of four channels. */
+    unsigned _n_groups;
+    
+    unsigned long _max_delay;
+    unsigned long _max_block;
+    
+    /** Frames of history per group. Power of two. */
+    unsigned long _size;
+    unsigned long _mask;
+    
+    /** Frame the next input is written to. */
+    unsigned long _pos = 0;
+    
+    /** History of all groups, each holding _size + _max_block frames of four samples. */
+    std::vector< float > _history;
+    
+    /** Delay per channel, padded to full groups. */
+    std::vector< unsigned long > _delays;
+    
+    /** Input of the unused channels of the last group. */
+    std::vector< float > _silence;
+    
+    /** Output of the unused channels of the last group. */
+    std::vector< float > _discard;
+    
+    /** @returns Start of the history of a group. */
+    float* _group_history( unsigned group );
+};
+
+} // namespace laproque
+
+#endif /* MultichannelDelay_hpp */
@@ -0,0 +1,113 @@
+//
+//  MultichannelFilter.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef MultichannelFilter_hpp
+#define MultichannelFilter_hpp
+
+#include <vector>
+#include "Filter.hpp"
+
+namespace laproque {
+
+/**
+ * This enum specifies the order of the sections in the MultichannelFilter class.
+ */
+enum filter_order
+{
+    FIRST_ORDER,
+    SECOND_ORDER
+};
+
+/**
+ * @class MultichannelFilter
+ * @brief Bank of independent IIR filters, one first or second order section per channel.
+ *
+ * The recursion of one filter can not be vectorized, but separate channels can. Channels are
+ * processed in groups of four, one channel per SSE lane, each with its own coefficients.
+ * Four groups advance together frame by frame, so 16 channels keep the pipeline busy.
+ * The sections are in transposed direct form II:
+ * \f[ y[n] = b_0 x[n] + s_1[n-1] \f]
+ * \f[ s_1[n] = b_1 x[n] - a_1 y[n] + s_2[n-1] \f]
+ * \f[ s_2[n] = b_2 x[n] - a_2 y[n] \f]
+ */
+class MultichannelFilter
+{
+public:
+    /**
+     * @param n_channels Number of channels.
+     * @param order Order of the filter section of every channel.
+     */
+    MultichannelFilter( unsigned n_channels, filter_order order=FIRST_ORDER );
+    
+    /**
+     * @brief Function for block processing with separate buffers per channel.
+     * @param input Buffers with input audio samples. First dimension n_channels, second dimension n_frames.
+     * @param output Buffers with output audio samples. First dimension n_channels, second dimension n_frames.
+     * @param n_frames Number of audio frames to be processed.
+     */
+    void process( float** input, float** output, unsigned long n_frames );
+    
+    /**
+     * @brief Function for block processing with interleaved channels.
+     * @param input Buffer with n_frames * n_channels input samples, all channels of the first frame first.
+     * @param output Buffer with n_frames * n_channels output samples, interleaved like the input.
+     * @param n_frames Number of audio frames to be processed.
+     */
+    void process_interleaved( float* input, float* output, unsigned long n_frames );
+    
+    /**
+     * @brief Set the coefficients of one channel.
+     * The coefficients are normalized by a_coeffs[0].
+     * @param channel Index of the channel.
+     * @param b_coeffs Non-recursive coefficients. Two elements for FIRST_ORDER, three for SECOND_ORDER.
+     * @param a_coeffs Recursive coefficients. Two elements for FIRST_ORDER, three for SECOND_ORDER.
+     */
+    void set_coeffs( unsigned channel, float* b_coeffs, float* a_coeffs );
+    
+    /**
+     * @brief Use the coefficients of a Filter for one channel.
+     * @param channel Index of the channel.
+     * @param filter Filter whose current coefficients are copied.
+     */
+    void set_filter( unsigned channel, Filter& filter );
+    
+    /** @brief Set all delay lines to 0. */
+    void reset();
+    
+    /** @returns Number of channels. */
+    unsigned get_n_channels();
+    
+private:
+    unsigned _n_channels;
+    filter_order _order;
+    
+    /** Number of groups of four channels. */
+    unsigned _n_groups;
+    
+    /** Number of frames processed in one step of process. */
+    static const unsigned BLOCK = 256;
+    
+    /** Coefficients b0, b1, b2, a1, a2 of four channels each, group by group. */
+    std::vector< float > _coeffs;
+    
+    /** States s1 and s2 of four channels each, group by group. */
+    std::vector< float > _states;
+    
+    /** Frames of four groups of one block, the lanes of a frame next to each other. */
+    std::vector< float > _frames;
+    
+    /** @brief Copy n_frames frames of the four channels of a group from separate buffers into _frames. */
+    void _transpose_in( float** input, unsigned group, unsigned long offset, unsigned long n_frames );
+    
+    /** @brief Copy n_frames frames of the four channels of a group from _frames into separate buffers. */
+    void _transpose_out( float** output, unsigned group, unsigned long offset, unsigned long n_frames );
+};
+
+} // namespace laproque
+
+#endif /* MultichannelFilter_hpp */
@@ -0,0 +1,167 @@
+//
+//  MultirateFilterbank.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.
+//
+
+#ifndef MultirateFilterbank_hpp
+#define MultirateFilterbank_hpp
+
+#include <vector>
+#include "Filter.hpp"
+#include "Delay.hpp"
+
+namespace laproque {
+
+/**
+ * @class MultirateFilterbank
+ * @brief One channel filter bank of first order butterworth filters which runs low bands at reduced sample rates.
+ *
+ * The crossovers are split like in the Filterbank, highest first. Whenever the remaining crossovers are
+ * far enough below the current sample rate, the remaining low signal is decimated by two with a
+ * polyphase halfband filter and split further at the lower rate. The part removed by the decimation is
+ * added to the band just below the last crossover, so the sum of all bands still equals the delayed input.
+ *
+ * The bands are brought back to the full rate by halfband interpolation, one stage per level.
+ * process_mix() sums weighted bands at the rate they were computed at and interpolates the sum once
+ * per level. Its cost is about twice the cost of the top level alone, independent of the number of bands.
+ * process() returns every band at the full rate and needs one interpolation chain per band.
+ */
+class MultirateFilterbank
+{
+public:
+    /**
+     * @param co_freqs Ascending crossover frequencies splitting the bands.
+     * @param sample_rate Audio sample frequency the filter bank operates with.
+     */
+    MultirateFilterbank(
+                        std::vector<float> co_freqs = std::vector<float>{1000.f}
+                        , unsigned sample_rate = 44100
+                        );
+
+    ~MultirateFilterbank();
+
+    /**
+     * @brief Function for block processing. All bands are delayed by get_latency() samples.
+     * @param input Pointer to buffer with input signal.
+     * @param output Pointer to buffer with band signals.
+     * Must hold: First dimension get_n_bands(), second dimension n_frames.
+     */
+    void process( float* input, float** output, unsigned long n_frames );
+
+    /**
+     * @brief Function for block processing of the weighted sum of all bands.
+     * The sum is delayed by get_latency() samples.
+     * @param input Pointer to buffer with input signal.
+     * @param output Pointer to buffer with output signal.
+     * @param n_frames Number of audio frames to be processed.
+     */
+    void process_mix( float* input, float* output, unsigned long n_frames );
+
+    /**
+     * @brief Set the gain factors of the bands used by process_mix(). All are 1 initially.
+     * @param weights One gain factor per band. Ignored if the number does not match.
+     */
+    void set_band_weights( std::vector<float> weights );
+
+    /**
+     * @brief Set new crossover frequency values. The levels the crossovers run at stay the same.
+     * @param co_freqs Must have the same length as on initialization.
+     * Every frequency is clipped to a quarter of the sample rate of its level.
+     */
+    void set_co_freqs( std::vector<float> co_freqs );
+
+    /** @brief Erase the states of all filters, decimators, interpolators and delays. */
+    void reset();
+
+    /** @returns Number of bands in the filter bank. */
+    unsigned get_n_bands();
+
+    /** @returns Number of sample rates used, including the full rate. */
+    unsigned get_n_levels();
+
+    /** @returns Delay of all outputs in samples. */
+    unsigned long get_latency();
+
+private:
+    /** Everything computed at one sample rate. */
+    struct _Level {
+        /** Sample rate of the level. The full rate divided by 2^level. */
+        unsigned sample_rate;
+        /** Crossover indices processed at this level, highest first. */
+        std::vector<unsigned> crossovers;
+        /** Low and high pass Filter of each crossover. */
+        std::vector<Filter> filters;
+        /** Band containing the low signal left after the crossovers of this level. */
+        unsigned low_band;
+        /** Band of the level above whose low signal is the input of this level. */
+        unsigned parent_band;
+        /** Output delay of this level in its own samples. */
+        unsigned long latency;
+
+        /** Input of this level. Decimated low signal of the level above. */
+        std::vector<float> input;
+        /** High pass output of each crossover. */
+        std::vector< std::vector<float> > highs;
+        /** Ping pong buffers for the low signal. */
+        std::vector<float> low_a, low_b;
+        /** Remaining low signal after all crossovers. */
+        float* low;
+        /** Decimator input. The last samples of the previous block come first. */
+        std::vector<float> history;
+        /** 1 if the next input sample produces a decimated sample. */
+        unsigned parity;
+        /** Number of samples of the current block at this level. */
+        unsigned long n_frames;
+    };
+
+    /** Sums bands level by level and interpolates the sum to the full rate. */
+    struct _Mixer {
+        std::vector<float> weights;
+        /** Levels below are skipped because they carry no weighted band. */
+        unsigned depth;
+        /** Aligns each level with the interpolated sum of the levels below. */
+        std::vector<Delay*> delays;
+        /** Sum of each level at the rate of the level. */
+        std::vector< std::vector<float> > sums;
+        /** Interpolator input. The last samples of the previous block come first. */
+        std::vector< std::vector<float> > history;
+        /** Interpolated samples of each level which were not used yet. */
+        std::vector< std::vector<float> > fifo;
+        std::vector<unsigned long> fifo_fill;
+    };
+
+    std::vector<float> _crossover_freqs;
+    unsigned _sample_rate;
+    unsigned _n_bands;
+    unsigned _n_levels;
+
+    std::vector<_Level> _levels;
+    /** One mixer per band for process(). */
+    std::vector<_Mixer> _band_mixers;
+    /** Mixer of process_mix(). */
+    _Mixer _mixer;
+
+    /** Nonzero taps of the halfband filter apart from the center tap. */
+    std::vector<float> _taps;
+
+    /** Size of internal buffer */
+    const unsigned _intern_buff_size = 1024;
+
+    void _create_mixer( _Mixer& mixer, std::vector<float> weights );
+    void _delete_mixer( _Mixer& mixer );
+    void _reset_mixer( _Mixer& mixer );
+
+    /** Splits n_frames input samples at all levels. */
+    void _split( float* input, unsigned long n_frames );
+    /** Sums and interpolates the last split into output. */
+    void _mix( _Mixer& mixer, float* output );
+    void _decimate( unsigned level );
+    void _interpolate( _Mixer& mixer, unsigned level );
+};
+
+} // namespace laproque
+
+#endif /* MultirateFilterbank_hpp */
@@ -0,0 +1,96 @@
+//
+//  PagePool.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef PagePool_hpp
+#define PagePool_hpp
+
+#include <vector>
+#include <atomic>
+
+namespace laproque {
+
+/**
+ * @class PagePool
+ * @brief Shared storage of fixed size sample pages for paged RingBuffer instances.
+ *
+ * Pages are allocated on first demand and kept for reuse when they are released.
+ * After reserve() the pool never allocates again. When the reserved pages run out, acquire() hands
+ * out the zero page instead, the RingBuffer drops the write and the failure is counted.
+ * Every page holds get_page_size() samples plus a tail of get_max_block() samples, which the
+ * RingBuffer uses to mirror the start of the following page.
+ * Acquiring and releasing is guarded by a spin lock, so delay lines processed in different threads can share one pool.
+ * The pool must outlive all RingBuffer instances using it.
+ */
+class PagePool
+{
+public:
+    /**
+     * @param page_size Number of samples per page. Rounded up to a power of two.
+     * @param max_block Maximum block size of the RingBuffer instances using this pool.
+     */
+    PagePool( unsigned long page_size = 4096, unsigned long max_block = 1024 );
+    ~PagePool();
+    
+    /**
+     * @returns A page with all samples set to 0.
+     * The zero page if reserve() was called and no reserved page is left.
+     */
+    float* acquire();
+    
+    /** @brief Hand a page back to the pool. */
+    void release( float* page );
+    
+    /**
+     * @brief Allocate pages in advance.
+     * Acquiring and releasing pages from the processing thread then never allocates memory.
+     * @param n_pages Number of pages available afterwards. No more pages are allocated later.
+     */
+    void reserve( unsigned long n_pages );
+    
+    /** @returns Page with all samples 0 which must never be written to. Stands in for pages not acquired. */
+    const float* get_zero_page();
+    
+    /** @returns Number of samples per page, without the tail. */
+    unsigned long get_page_size();
+    
+    /** @returns Number of samples in the tail of each page. */
+    unsigned long get_max_block();
+    
+    /** @returns Number of pages currently acquired. */
+    unsigned long get_n_used();
+    
+    /** @returns Number of pages allocated in total. */
+    unsigned long get_n_allocated();
+    
+    /** @returns Number of times acquire() ran out of reserved pages and returned the zero page. */
+    unsigned long get_n_failed();
+    
+private:
+    unsigned long _page_size;
+    unsigned long _max_block;
+    
+    /** Pages ready for reuse. */
+    std::vector< float* > _free_pages;
+    
+    /** All pages ever allocated. */
+    std::vector< float* > _all_pages;
+    
+    float* _zero_page;
+    
+    /** True after reserve(). acquire() does not allocate then. */
+    bool _reserved = false;
+    unsigned long _n_failed = 0;
+    
+    std::atomic_flag _lock = ATOMIC_FLAG_INIT;
+    
+    float* _allocate();
+};
+
+} // namespace laproque
+
+#endif /* PagePool_hpp */
@@ -0,0 +1,91 @@
+//
+//  Resampler.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.
+//
+
+#ifndef Resampler_hpp
+#define Resampler_hpp
+
+#include <vector>
+
+namespace laproque {
+
+/**
+ * @class Resampler
+ * @brief One channel sample rate converter for arbitrary ratios.
+ *
+ * Every output sample is a weighted sum of n_taps input samples around its position. The weights are a
+ * blackman windowed sinc like in SincLP, tabulated for n_phases positions between two input samples and
+ * interpolated linearly between neighbouring positions. The sums are computed four taps at once with SSE.
+ * When converting to a lower rate, the sinc is stretched to cut off below the output Nyquist frequency.
+ */
+class Resampler
+{
+public:
+    /**
+     * @param in_rate Sample rate of the input signal.
+     * @param out_rate Sample rate of the output signal.
+     * @param n_taps Kernel length in samples of the lower of both rates. Rounded up to a multiple of 4.
+     * @param n_phases Number of tabulated positions between two input samples.
+     * @param max_block Maximum number of input frames processed in one step of block processing.
+     */
+    Resampler( double in_rate, double out_rate, unsigned n_taps=64, unsigned n_phases=256, unsigned max_block=1024 );
+
+    /**
+     * @brief Streaming block processing. Output lags the input by get_latency() input samples.
+     * @param input Buffer with n_frames input samples.
+     * @param output Buffer receiving the output samples. Must hold get_max_output( n_frames ) samples.
+     * @param n_frames Number of input frames.
+     * @returns Number of output frames written.
+     */
+    unsigned long process( float* input, float* output, unsigned long n_frames );
+
+    /**
+     * @brief Convert a whole signal at once, without latency.
+     * Starts from a reset state and leaves the Resampler reset.
+     * @param input Buffer with the whole input signal.
+     * @param n_frames Number of input frames.
+     * @param output Receives n_frames * out_rate / in_rate samples, rounded up.
+     */
+    void convert( float* input, unsigned long n_frames, std::vector<float>& output );
+
+    /** @brief Erase the input history and start again at the first output sample. */
+    void reset();
+
+    /** @returns Maximum number of output frames produced from n_frames input frames. */
+    unsigned long get_max_output( unsigned long n_frames );
+
+    /** @returns Delay of the streaming output in input samples. */
+    unsigned get_latency();
+
+    /** @returns Number of taps of the kernel at the input rate. */
+    unsigned get_n_taps();
+
+private:
+    double _in_rate;
+    double _out_rate;
+    /** Input samples advanced per output sample. */
+    double _step;
+
+    unsigned _n_taps;
+    unsigned _n_phases;
+    unsigned _max_block;
+
+    /** n_phases + 1 rows of n_taps weights. Row p is for outputs p / n_phases input samples after the center tap. */
+    std::vector<float> _kernels;
+
+    /** Input samples not used up yet. */
+    std::vector<float> _history;
+    unsigned long _n_history;
+    /** Index in _history of the first tap of the next output sample. Can lie beyond the stored input. */
+    unsigned long _first_tap;
+    /** Fraction of an input sample the next output sample lies behind the first tap position. */
+    double _fraction;
+};
+
+} // namespace laproque
+
+#endif /* Resampler_hpp */
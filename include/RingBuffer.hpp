@@ -0,0 +1,232 @@
+//
+//  RingBuffer.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef RingBuffer_hpp
+#define RingBuffer_hpp
+
+#include <stddef.h>
+#include "PagePool.hpp"
+
+namespace laproque {
+
+/**
+ * This enum specifies how the samples of a RingBuffer are stored.
+ */
+enum sample_format
+{
+    /** 32 bit float. Blocks can be accessed in place with get_block(). */
+    FLOAT32,
+    /** 16 bit IEEE half precision float. Converted with F16C where available. */
+    FLOAT16,
+    /** 16 bit integer with full scale 1.0. Larger values are clipped. */
+    INT16
+};
+
+/**
+ * @class RingBuffer
+ * @brief Sample history storage shared by the delay modules.
+ *
+ * The number of stored samples is a power of two, so positions wrap by masking.
+ * The history is split into pages. Behind every page the first max_block samples of the
+ * following page are mirrored. Thus every block of up to max_block frames can be read
+ * contiguously from any position and processing loops never have to check for the buffer end.
+ *
+ * Without a PagePool the history is one contiguous page allocated on construction.
+ * With a PagePool, pages are only acquired when non-zero samples are written to them, and handed
+ * back when the writer reaches them again. Memory use then follows the signal actually stored,
+ * and reset() only touches acquired pages.
+ *
+ * The 16 bit sample formats halve memory and bandwidth. They are converted when writing and
+ * in read_block() and add_block(), which work with every format.
+ */
+class RingBuffer
+{
+public:
+    /**
+     * @param min_size Number of frames of history which must be accessible in addition to one block.
+     * @param max_block Maximum number of frames of one contiguous read or write. Limited to the max_block of the pool.
+     * @param pool Shared page storage. If nullptr, the history is allocated at once.
+     * @param format Storage format of the samples.
+     */
+    RingBuffer( unsigned long min_size, unsigned long max_block = 1024, PagePool* pool = nullptr, sample_format format = FLOAT32 );
+    ~RingBuffer();
+
+    /**
+     * @brief Append samples to the history.
+     * @param input Buffer with audio samples.
+     * @param n_frames Number of frames to be written. Must not exceed get_size().
+     */
+    void write( const float* input, unsigned long n_frames );
+
+    /** @brief Append one sample to the history. */
+    void write_one( float input )
+    {
+        if ( _pool || _format != FLOAT32 ) {
+            write( &input, 1 );
+            return;
+        }
+        _pages[0][_pos] = input;
+        _pages[0][_pos < _max_block ? _pos + _size : _pos] = input;
+        _pos = (_pos + 1) & _mask;
+    }
+
+    /**
+     * @brief Overwrite the most recently written frames.
+     * @param input Buffer with audio samples replacing the last n_frames written.
+     * @param n_frames Number of frames to be replaced.
+     */
+    void replace( const float* input, unsigned long n_frames );
+
+    /**
+     * @returns Pointer to n_frames contiguous samples. The last one of them was written
+     * delay frames before the most recent sample. After writing a block, get_block( delay, n_frames )
+     * thus holds that block delayed by delay frames. n_frames must not exceed get_max_block().
+     * Only available for the FLOAT32 format.
+     */
+    const float* get_block( unsigned long delay, unsigned long n_frames )
+    {
+        unsigned long start = (_pos - n_frames - delay) & _mask;
+        return _pages[start >> _page_shift] + (start & _page_mask);
+    }
+    
+    /**
+     * @brief Access a block of any length up to get_max_span() in place.
+     *
+     * The block which get_block( delay, n_frames ) would return is split into at most two
+     * contiguous pieces, in time order. Only available for the FLOAT32 format.
+     * @param spans Array of two pointers receiving the start of each piece.
+     * @param lengths Array of two values receiving the number of frames of each piece.
+     * @returns Number of pieces, 1 or 2. 0 if the block can not be accessed in place.
+     */
+    unsigned get_spans( unsigned long delay, unsigned long n_frames, const float** spans, unsigned long* lengths );
+    
+    /** @returns Maximum number of frames get_spans() can always return. */
+    unsigned long get_max_span();
+    
+    /**
+     * @brief Copy the block get_block( delay, n_frames ) would point to. Works with every format.
+     * @param output Buffer receiving n_frames samples.
+     */
+    void read_block( unsigned long delay, unsigned long n_frames, float* output );
+    
+    /**
+     * @brief Add the block get_block( delay, n_frames ) would point to, multiplied by weight, to output.
+     */
+    void add_block( unsigned long delay, unsigned long n_frames, float weight, float* output );
+    
+    /**
+     * @brief Add the block get_block( delay, n_frames ) would point to, multiplied sample by sample with gains, to output.
+     */
+    void add_block( unsigned long delay, unsigned long n_frames, const float* gains, float* output );
+
+    /**
+     * @brief Add a block read with a fractional delay moving linearly from start_delay to end_delay, weighted with
+     * a gain moving from start_weight to end_weight, to output.
+     *
+     * Frame idx of the block is read with the delay start_delay + (end_delay - start_delay) * idx / n_frames
+     * by cubic Hermite interpolation. The delays must be at least 2 and
+     * n_frames + | end_delay - start_delay | + 6 must not exceed get_max_block(). Only available for the FLOAT32 format.
+     */
+    void add_interpolated( float start_delay, float end_delay, float start_weight, float end_weight, unsigned long n_frames, float* output );
+
+    /** @returns Sample written delay frames before the most recent one. */
+    float get_sample( unsigned long delay )
+    {
+        unsigned long idx = (_pos - 1 - delay) & _mask;
+        if ( _format == FLOAT32 ) return _pages[idx >> _page_shift][idx & _page_mask];
+        
+        float sample;
+        _load( _sample_address( idx >> _page_shift, idx & _page_mask ), 1, &sample );
+        return sample;
+    }
+
+    /** @brief Set all samples to 0 and move the write position to the start. */
+    void reset();
+
+    /** @returns Number of samples the history holds. Always a power of two. */
+    unsigned long get_size();
+
+    /** @returns Maximum number of frames accessible in one contiguous block. */
+    unsigned long get_max_block();
+    
+    /** @returns Number of pages currently holding samples. */
+    unsigned long get_n_pages_used();
+    
+    /** @returns Storage format of the samples. */
+    sample_format get_format();
+
+private:
+    /** Number of samples in the history. */
+    unsigned long _size;
+
+    /** _size - 1, used to wrap positions. */
+    unsigned long _mask;
+
+    /** Number of samples mirrored behind the end of every page. */
+    unsigned long _max_block;
+
+    /** Position the next sample is written to. */
+    unsigned long _pos;
+    
+    /** Source of the pages. nullptr if the history is one page owned by this instance. */
+    PagePool* _pool;
+    
+    /** Page storage, each page holding _page_size + _max_block samples in _format. */
+    float** _pages;
+    
+    /** Number of pages. */
+    unsigned long _n_pages;
+    
+    /** Samples per page. */
+    unsigned long _page_size;
+    
+    /** _page_size - 1, position within a page. */
+    unsigned long _page_mask;
+    
+    /** log2( _page_size ), page of a position. */
+    unsigned _page_shift;
+    
+    sample_format _format;
+    
+    /** Bytes per stored sample. */
+    unsigned long _sample_bytes;
+    
+    /** Pages not acquired point to the zero page of the pool. */
+    bool _is_acquired( unsigned long page );
+    
+    /**
+     * @brief Acquire a page if it is not yet.
+     * @returns False if the pool has no page left, the write is dropped then.
+     */
+    bool _get_writable( unsigned long page );
+    
+    /** @brief Return a page to the pool. */
+    void _release( unsigned long page );
+    
+    /** @returns Address of a stored sample. */
+    char* _sample_address( unsigned long page, unsigned long offset )
+    {
+        return (char*)(_pages[page]) + offset * _sample_bytes;
+    }
+    
+    /** @returns Address of the first sample of the block get_block( delay, n_frames ) would point to. */
+    const char* _block_address( unsigned long delay, unsigned long n_frames );
+    
+    /** @brief Convert n_frames samples to the storage format. */
+    void _store( const float* input, unsigned long n_frames, char* dest );
+    
+    /** @brief Convert n_frames stored samples to float. */
+    void _load( const char* source, unsigned long n_frames, float* output );
+    
+    /** @returns true if all n_frames samples are 0. */
+    static bool _is_silent( const float* input, unsigned long n_frames );
+};
+
+} // namespace laproque
+
+#endif /* RingBuffer_hpp */
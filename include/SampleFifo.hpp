@@ -0,0 +1,82 @@
+//
+//  SampleFifo.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.
+//
+
+#ifndef SampleFifo_hpp
+#define SampleFifo_hpp
+
+#include <vector>
+#include <atomic>
+
+namespace laproque {
+
+/**
+ * @class SampleFifo
+ * @brief Lock-free sample queue between one writing and one reading thread.
+ *
+ * Both ends count the frames passed through them since construction. Each counter is only
+ * advanced by its own thread, so neither side ever waits for the other. Writing stops when the
+ * queue is full and reading stops when it is empty, both return the number of frames handled.
+ * The number of stored samples is a power of two, so positions wrap by masking.
+ */
+class SampleFifo
+{
+public:
+    /** @param min_size Number of frames which must fit into the queue. Rounded up to a power of two. */
+    SampleFifo( unsigned long min_size );
+
+    /**
+     * @brief Append samples. Must only be called from the writing thread.
+     * @param input Buffer with n_frames audio samples.
+     * @param n_frames Number of frames to be written.
+     * @returns Number of frames written. Less than n_frames if the queue is full.
+     */
+    unsigned long write( const float* input, unsigned long n_frames );
+
+    /**
+     * @brief Take the oldest samples out of the queue. Must only be called from the reading thread.
+     * @param output Buffer receiving up to n_frames samples.
+     * @param n_frames Number of frames requested.
+     * @returns Number of frames read. Less than n_frames if the queue runs empty.
+     */
+    unsigned long read( float* output, unsigned long n_frames );
+
+    /**
+     * @brief Drop all samples written before a write position. Must only be called from the reading thread.
+     * @param position Value get_write_position() had when the first sample to keep was written.
+     */
+    void skip_to( unsigned long long position );
+
+    /** @returns Number of frames which can be read. */
+    unsigned long get_n_readable();
+
+    /** @returns Number of frames which can be written. */
+    unsigned long get_n_writable();
+
+    /** @returns Number of frames written since construction. */
+    unsigned long long get_write_position();
+
+    /** @returns Number of frames read or skipped since construction. */
+    unsigned long long get_read_position();
+
+    /** @returns Number of frames the queue can hold. */
+    unsigned long get_size();
+
+private:
+    std::vector<float> _buffer;
+    unsigned long _size;
+    unsigned long _mask;
+
+    /** Only advanced by the writing thread. */
+    std::atomic<unsigned long long> _write_pos{0};
+    /** Only advanced by the reading thread. */
+    std::atomic<unsigned long long> _read_pos{0};
+};
+
+} // namespace laproque
+
+#endif /* SampleFifo_hpp */
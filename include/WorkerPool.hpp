@@ -0,0 +1,96 @@
+//
+//  WorkerPool.hpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef WorkerPool_hpp
+#define WorkerPool_hpp
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+namespace laproque {
+
+/**
+ * @class WorkerPool
+ * @brief Fixed set of threads which run one job in parallel per processing block.
+ *
+ * The threads are started on construction. Waiting threads spin on an atomic counter
+ * for a short while, so jobs following each other closely start without a context switch.
+ * After that they block on a condition variable. The pool must not idle-spin: between
+ * processing blocks and while nothing is processed, the workers sleep. run() only locks the
+ * mutex when it has to wake a sleeping worker or wait for a straggler.
+ *
+ * The thread in run() waits for the workers, so they must not run at a lower priority than it.
+ * The workers either get SCHED_FIFO with a fixed priority, or take over the real-time policy
+ * and priority of the thread which calls run() first. Where real-time scheduling is not
+ * permitted, the workers keep the default policy.
+ */
+class WorkerPool
+{
+public:
+    /**
+     * @param n_workers Number of parallel workers including the thread calling run().
+     * @param priority SCHED_FIFO priority of the workers. 0 to use the scheduling of the first thread calling run().
+     */
+    WorkerPool( unsigned n_workers, int priority = 0 );
+    ~WorkerPool();
+    
+    /**
+     * @brief Calls job( context, worker ) once for every worker index and returns when all calls are done.
+     * The calling thread runs worker index 0 itself.
+     * @param job Function which processes the part of the work belonging to the worker index.
+     * @param context Pointer which is passed on to the job.
+     */
+    void run( void (*job)( void* context, unsigned worker ), void* context );
+    
+    /** @returns Number of parallel workers including the thread calling run(). */
+    unsigned get_n_workers();
+    
+private:
+    /** Loop of every additional thread. */
+    void _work( unsigned worker );
+    
+    /** @brief Give all workers a scheduling policy and priority. Failures are ignored. */
+    void _set_scheduling( int policy, int priority );
+    
+    /** True until the first call of run() if the workers take over its scheduling. */
+    bool _inherit_scheduling;
+    
+    std::vector< std::thread > _threads;
+    
+    /** Counts calls of run(). Threads start working when it changes. */
+    std::atomic<unsigned> _generation{0};
+    
+    /** Number of threads which have not finished the current job. */
+    std::atomic<unsigned> _n_busy{0};
+    
+    std::atomic<bool> _quit{false};
+    
+    /** Number of checks of an atomic counter before a waiting thread blocks. */
+    static const unsigned MAX_SPINS = 2000;
+    
+    std::mutex _mutex;
+    /** Wakes the workers when a job starts or the pool quits. */
+    std::condition_variable _job_started;
+    /** Wakes the thread in run() when the last worker is done. */
+    std::condition_variable _job_done;
+    
+    /** Number of workers blocked on _job_started. */
+    std::atomic<unsigned> _n_sleeping{0};
+    /** True while the thread in run() is blocked on _job_done. */
+    std::atomic<bool> _caller_sleeping{false};
+    
+    void (*_job)( void*, unsigned );
+    void* _context;
+};
+
+} // namespace laproque
+
+#endif /* WorkerPool_hpp */
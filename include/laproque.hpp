@@ -17,11 +17,26 @@
 #include "JackPlugin.hpp"
 #include "FadingMultiDelay.hpp"
 #include "MultiDelay.hpp"
+#include "HybridMultiDelay.hpp"
 #include "complexmath.hpp"
 #include "FadingDelay.hpp"
 #include "TimeKeeper.hpp"
 #include "FFThelper.hpp"
 #include "CrossFader.hpp"
+#include "PagePool.hpp"
+#include "RingBuffer.hpp"
+#include "WorkerPool.hpp"
+#include "FDN.hpp"
+#include "ModulatedDelay.hpp"
+#include "MultichannelDelay.hpp"
+#include "ArrayDelay.hpp"
+#include "Beamformer.hpp"
+#include "MultichannelFilter.hpp"
+#include "CrossoverFilterbank.hpp"
+#include "MultirateFilterbank.hpp"
+#include "FFTFilterbank.hpp"
+#include "Resampler.hpp"
+#include "SampleFifo.hpp"
 
 
 #endif /* LAPROQUE_HPP */
@@ -0,0 +1,235 @@
+//
+//  ArrayDelay.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "ArrayDelay.hpp"
+#include <algorithm>
+#include <cstring>
+
+#include <xmmintrin.h>
+
+// output += input * gain
+static inline void add_scaled( const float* input, float gain, float* output, unsigned long n_frames )
+{
+    const __m128 gains = _mm_set1_ps( gain );
+    unsigned long idx = 0;
+    
+    for ( ; idx + 4 <= n_frames; idx += 4 ) {
+        __m128 value = _mm_mul_ps( _mm_loadu_ps( input + idx ), gains );
+        _mm_storeu_ps( output + idx, _mm_add_ps( _mm_loadu_ps( output + idx ), value ) );
+    }
+    for ( ; idx < n_frames; idx++ ) {
+        output[idx] += input[idx] * gain;
+    }
+}
+
+const unsigned laproque::ArrayDelay::NEW_SET;
+
+laproque::ArrayDelay::ArrayDelay( unsigned n_outputs, unsigned max_delay, unsigned max_block ) :
+_ring( max_delay + 8, 2*max_block + 8 )
+{
+    _n_outputs = n_outputs;
+    _max_delay = max_delay;
+    _max_block = std::max( max_block, 1u );
+    
+    // The history is read with moving delays over up to twice the block plus the interpolation neighbours.
+    _moving.resize( _max_block );
+}
+
+void laproque::ArrayDelay::process( float* input, float** outputs, unsigned long n_frames )
+{
+    _process( input, outputs, n_frames, false );
+}
+
+void laproque::ArrayDelay::process_add( float* input, float** outputs, unsigned long n_frames )
+{
+    _process( input, outputs, n_frames, true );
+}
+
+void laproque::ArrayDelay::_process( float* input, float** outputs, unsigned long n_frames, bool add )
+{
+    // Take over a tap table from the control thread.
+    if ( _latest_set.load() & NEW_SET ) {
+        unsigned long layout = _sets[_front_set].layout;
+        _front_set = _latest_set.exchange( _front_set ) & ~NEW_SET;
+        _Taps& taps = _sets[_front_set];
+        
+        // The set brings a buffer of the right size, which keeps the current delays from now on.
+        if ( taps.layout == layout ) {
+            std::copy( _current_delays.begin(), _current_delays.end(), taps.current.begin() );
+        }
+        else {
+            std::copy( taps.delays.begin(), taps.delays.end(), taps.current.begin() );
+        }
+        _current_delays.swap( taps.current );
+    }
+    
+    const _Taps& taps = _sets[_front_set];
+    const float* delayed = nullptr;
+    float max_change = float(n_frames);
+    unsigned long n_done = 0;
+    
+    while ( n_done < n_frames ) {
+        unsigned long n_ready = std::min( n_frames - n_done, _max_block );
+        
+        _ring.write( input + n_done, n_ready );
+        
+        if ( !add ) {
+            for ( unsigned output = 0; output < _n_outputs; output++ ) {
+                std::memset( outputs[output] + n_done, 0, n_ready*sizeof(float) );
+            }
+        }
+        
+        // Position of this block within the process call.
+        float start = float(n_done) / float(n_frames);
+        float end = float(n_done + n_ready) / float(n_frames);
+        
+        // Routes are ordered by tap, so every block is looked up once.
+        unsigned last_tap = unsigned(-1);
+        
+        for ( unsigned route = 0; route < taps.routes.size(); route++ ) {
+            const _Route& current = taps.routes[route];
+            
+            if ( current.tap != last_tap ) {
+                last_tap = current.tap;
+                float delay = _current_delays[current.tap];
+                float target = float(taps.delays[current.tap]);
+                
+                if ( delay == target || delay < 2.f || target < 2.f ) {
+                    delayed = _ring.get_block( taps.delays[current.tap], n_ready );
+                }
+                else {
+                    // The delay may change by at most one sample per sample.
+                    float delay_change = std::min( std::max( target, delay - max_change ), delay + max_change ) - delay;
+                    std::memset( _moving.data(), 0, n_ready*sizeof(float) );
+                    _ring.add_interpolated( delay + delay_change * start, delay + delay_change * end,
+                                            1.f, 1.f, n_ready, _moving.data() );
+                    delayed = _moving.data();
+                }
+            }
+            add_scaled( delayed, current.gain, outputs[current.output] + n_done, n_ready );
+        }
+        
+        n_done += n_ready;
+    }
+    
+    for ( unsigned tap = 0; tap < _current_delays.size(); tap++ ) {
+        float delay = _current_delays[tap];
+        float target = float(taps.delays[tap]);
+        if ( delay < 2.f || target < 2.f ) _current_delays[tap] = target;
+        else _current_delays[tap] = std::min( std::max( target, delay - max_change ), delay + max_change );
+    }
+}
+
+void laproque::ArrayDelay::set_taps( unsigned long* delays, float* gains, unsigned n_taps )
+{
+    n_taps = std::min( n_taps, _n_outputs );
+    
+    _Taps& set = _sets[_back_set];
+    set.delays.resize( n_taps );
+    set.routes.clear();
+    set.layout = _sets[_published_set].layout + 1;
+    
+    for ( unsigned tap = 0; tap < n_taps; tap++ ) {
+        set.delays[tap] = std::min( delays[tap], _max_delay );
+        if ( gains[tap] != 0.f ) {
+            set.routes.push_back( { tap, tap, gains[tap] } );
+        }
+    }
+    
+    _publish_set();
+}
+
+void laproque::ArrayDelay::set_matrix( unsigned long* delays, float* gains, unsigned n_taps )
+{
+    _Taps& set = _sets[_back_set];
+    set.delays.resize( n_taps );
+    set.routes.clear();
+    set.layout = _sets[_published_set].layout + 1;
+    
+    for ( unsigned tap = 0; tap < n_taps; tap++ ) {
+        set.delays[tap] = std::min( delays[tap], _max_delay );
+        
+        for ( unsigned output = 0; output < _n_outputs; output++ ) {
+            float gain = gains[tap * _n_outputs + output];
+            if ( gain != 0.f ) {
+                set.routes.push_back( { tap, output, gain } );
+            }
+        }
+    }
+    
+    _publish_set();
+}
+
+void laproque::ArrayDelay::set_delay( unsigned tap, unsigned long delay )
+{
+    if ( tap >= get_n_taps() || delay > _max_delay ) return;
+    
+    _Taps& set = _edit_set();
+    set.delays[tap] = delay;
+    
+    _publish_set();
+}
+
+void laproque::ArrayDelay::set_gain( unsigned tap, unsigned output, float gain )
+{
+    if ( tap >= get_n_taps() || output >= _n_outputs ) return;
+    
+    _Taps& set = _edit_set();
+    
+    // Keep the routes ordered by tap and output.
+    std::vector< _Route >::iterator route = set.routes.begin();
+    while ( route != set.routes.end() && (route->tap < tap || (route->tap == tap && route->output < output)) ) {
+        route++;
+    }
+    
+    if ( route != set.routes.end() && route->tap == tap && route->output == output ) {
+        if ( gain != 0.f ) route->gain = gain;
+        else set.routes.erase( route );
+    }
+    else if ( gain != 0.f ) {
+        set.routes.insert( route, { tap, output, gain } );
+    }
+    
+    _publish_set();
+}
+
+laproque::ArrayDelay::_Taps& laproque::ArrayDelay::_edit_set()
+{
+    _Taps& set = _sets[_back_set];
+    const _Taps& published = _sets[_published_set];
+    set.delays = published.delays;
+    set.routes = published.routes;
+    set.layout = published.layout;
+    return set;
+}
+
+void laproque::ArrayDelay::_publish_set()
+{
+    // The processing thread swaps this buffer in, so it never resizes its own.
+    _Taps& set = _sets[_back_set];
+    set.current.resize( set.delays.size() );
+    
+    // A set which has not been applied yet comes back and gets overwritten next time.
+    _published_set = _back_set;
+    _back_set = _latest_set.exchange( _back_set | NEW_SET ) & ~NEW_SET;
+}
+
+void laproque::ArrayDelay::reset()
+{
+    _ring.reset();
+}
+
+unsigned laproque::ArrayDelay::get_n_outputs()
+{
+    return _n_outputs;
+}
+
+unsigned laproque::ArrayDelay::get_n_taps()
+{
+    return unsigned(_sets[_published_set].delays.size());
+}
@@ -0,0 +1,154 @@
+//
+//  Beamformer.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "Beamformer.hpp"
+#include <algorithm>
+#include <cstring>
+
+const unsigned laproque::Beamformer::NEW_SET;
+
+laproque::Beamformer::Beamformer( unsigned n_inputs, unsigned n_beams, unsigned max_delay, unsigned max_block )
+{
+    _n_inputs = n_inputs;
+    _n_beams = n_beams;
+    _max_block = max_block;
+    _max_delay = float(max_delay);
+    
+    // Reading with a moving delay needs up to twice the block plus the interpolation neighbours.
+    for ( unsigned input = 0; input < _n_inputs; input++ ) {
+        _histories.push_back( new RingBuffer( max_delay + 8, 2*max_block + 8 ) );
+    }
+    
+    // All beams start without delay difference and with zero weights.
+    unsigned n_values = _n_beams * _n_inputs;
+    for ( _Steering* steering : { &_current, &_target, &_sets[0], &_sets[1], &_sets[2] } ) {
+        steering->delays.assign( n_values, 2.f );
+        steering->weights.assign( n_values, 0.f );
+    }
+}
+
+laproque::Beamformer::~Beamformer()
+{
+    for ( unsigned input = 0; input < _n_inputs; input++ ) {
+        delete _histories[input];
+    }
+}
+
+void laproque::Beamformer::process( float** inputs, float** beams, unsigned long n_frames )
+{
+    unsigned beam, input, value;
+    unsigned n_values = _n_beams * _n_inputs;
+    
+    // Take over steering values from the control thread.
+    if ( _latest_set.load() & NEW_SET ) {
+        _front_set = _latest_set.exchange( _front_set ) & ~NEW_SET;
+        _target = _sets[_front_set];
+    }
+    
+    float max_change = float(n_frames);
+    unsigned long n_done = 0;
+    
+    while ( n_done < n_frames ) {
+        unsigned long n_ready = std::min( n_frames - n_done, (unsigned long)(_max_block) );
+        
+        for ( input = 0; input < _n_inputs; input++ ) {
+            _histories[input]->write( inputs[input] + n_done, n_ready );
+        }
+        
+        // Position of this block within the process call.
+        float start = float(n_done) / float(n_frames);
+        float end = float(n_done + n_ready) / float(n_frames);
+        
+        for ( beam = 0; beam < _n_beams; beam++ ) {
+            float* output = beams[beam] + n_done;
+            std::memset( output, 0, n_ready*sizeof(float) );
+            
+            for ( input = 0; input < _n_inputs; input++ ) {
+                value = beam * _n_inputs + input;
+                float delay = _current.delays[value];
+                float weight = _current.weights[value];
+                // The delay may change by at most one sample per sample.
+                float end_delay = std::min( std::max( _target.delays[value], delay - max_change ), delay + max_change );
+                float delay_change = end_delay - delay;
+                float weight_change = _target.weights[value] - weight;
+                
+                if ( weight == 0.f && weight_change == 0.f ) continue;
+                
+                _histories[input]->add_interpolated( delay + delay_change * start, delay + delay_change * end,
+                                                     weight + weight_change * start, weight + weight_change * end,
+                                                     n_ready, output );
+            }
+        }
+        
+        n_done += n_ready;
+    }
+    
+    for ( value = 0; value < n_values; value++ ) {
+        float delay = _current.delays[value];
+        _current.delays[value] = std::min( std::max( _target.delays[value], delay - max_change ), delay + max_change );
+    }
+    _current.weights = _target.weights;
+}
+
+void laproque::Beamformer::set_steering( unsigned beam, float* delays, float* weights )
+{
+    if ( beam >= _n_beams ) return;
+    
+    // Keep the other beams as passed last.
+    _Steering& set = _sets[_back_set];
+    set.delays = _sets[_published_set].delays;
+    set.weights = _sets[_published_set].weights;
+    
+    for ( unsigned input = 0; input < _n_inputs; input++ ) {
+        set.delays[beam * _n_inputs + input] = _clip_delay( delays[input] );
+        set.weights[beam * _n_inputs + input] = weights[input];
+    }
+    
+    _publish_set();
+}
+
+void laproque::Beamformer::set_all_steering( float* delays, float* weights )
+{
+    _Steering& set = _sets[_back_set];
+    
+    for ( unsigned value = 0; value < _n_beams * _n_inputs; value++ ) {
+        set.delays[value] = _clip_delay( delays[value] );
+        set.weights[value] = weights[value];
+    }
+    
+    _publish_set();
+}
+
+void laproque::Beamformer::_publish_set()
+{
+    // A set which has not been applied yet comes back and gets overwritten next time.
+    _published_set = _back_set;
+    _back_set = _latest_set.exchange( _back_set | NEW_SET ) & ~NEW_SET;
+}
+
+float laproque::Beamformer::_clip_delay( float delay )
+{
+    return std::min( std::max( delay, 2.f ), _max_delay - 2.f );
+}
+
+void laproque::Beamformer::reset()
+{
+    for ( unsigned input = 0; input < _n_inputs; input++ ) {
+        _histories[input]->reset();
+    }
+}
+
+unsigned laproque::Beamformer::get_n_inputs()
+{
+    return _n_inputs;
+}
+
+unsigned laproque::Beamformer::get_n_beams()
+{
+    return _n_beams;
+}
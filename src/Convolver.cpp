@@ -9,9 +9,10 @@
 #include "Convolver.hpp"
 #include <math.h>
 #include <cstring>
+#include <algorithm>
 
-laproque::Convolver::Convolver(float* imp_resp, unsigned long n_samples, unsigned block_size)
-: _fft_size( block_size * 2 ),  _fft( block_size * 2 )
+laproque::Convolver::Convolver(float* imp_resp, unsigned long n_samples, unsigned block_size, unsigned planner_flags)
+: _fft_size( block_size * 2 ),  _fft( block_size * 2, planner_flags )
 {
     _block_size = block_size;
     _fft_size = _block_size * 2;
@@ -29,9 +30,16 @@ laproque::Convolver::Convolver(float* imp_resp, unsigned long n_samples, unsigne
         _input[idx] = 0.f;
     }
     
+    set_imp_response( imp_resp, n_samples );
+}
+
+void laproque::Convolver::set_imp_response( float* imp_resp, unsigned long n_samples )
+{
+    n_samples = std::min( n_samples, (unsigned long)(_block_size) * _n_parts );
+    
     // Zeropadding of impulse response to multiple of block size.
     float* padded_imp_resp = fftwf_alloc_real( _block_size * (_n_parts) );
-    for ( unsigned idx = _block_size * (_n_parts-1); idx < _block_size * (_n_parts); idx++ ) {
+    for ( unsigned long idx = n_samples; idx < _block_size * (_n_parts); idx++ ) {
         padded_imp_resp[idx] = 0.f;
     }
     memcpy( padded_imp_resp, imp_resp, n_samples * sizeof(float) );
@@ -64,8 +72,6 @@ laproque::Convolver::~Convolver()
     fftwf_free( _output_spectr );
     fftwf_free( _multiply_buffer );
     fftwf_free( _result );
-    
-    fftwf_cleanup();
 }
 
 void laproque::Convolver::_make_allocations()
@@ -138,7 +144,31 @@ void laproque::Convolver::process( float *in_buffer, float *out_buffer )
     memcpy( _input, in_buffer, _block_size*sizeof(float) );
     
     // Shift the spectrum buffer for next run.
-    memcpy( _input_spectra+_spectrum_size, _input_spectra, (_spectra_size-_spectrum_size)*sizeof(fftwf_complex) );
+    memmove( _input_spectra+_spectrum_size, _input_spectra, (_spectra_size-_spectrum_size)*sizeof(fftwf_complex) );
+}
+
+void laproque::Convolver::set_input_history( float* history )
+{
+    // Partition spectra like after processing the history, newest partition first.
+    for ( unsigned part = 1; part < _n_parts; part++ ) {
+        memcpy( _input, history + (_n_parts-1-part)*_block_size, _fft_size*sizeof(float) );
+        _fft.real2complex( _input, _input_spectra + part*_spectrum_size );
+    }
+    
+    // Save last input.
+    memcpy( _input, history + (_n_parts-1)*_block_size, _block_size*sizeof(float) );
+}
+
+void laproque::Convolver::get_input_state( fftwf_complex* spectra, float* last_input )
+{
+    memcpy( spectra, _input_spectra, _spectra_size*sizeof(fftwf_complex) );
+    memcpy( last_input, _input, _block_size*sizeof(float) );
+}
+
+void laproque::Convolver::set_input_state( fftwf_complex* spectra, float* last_input )
+{
+    memcpy( _input_spectra, spectra, _spectra_size*sizeof(fftwf_complex) );
+    memcpy( _input, last_input, _block_size*sizeof(float) );
 }
 
 void laproque::Convolver::reset_input_buffer()
@@ -0,0 +1,254 @@
+//
+//  CrossoverFilterbank.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "CrossoverFilterbank.hpp"
+#include <algorithm>
+#include <cstring>
+#include <math.h>
+
+#include <pmmintrin.h>
+
+/** Number of coefficients and states per section. */
+static const unsigned N_COEFFS = 5;
+static const unsigned N_STATES = 2;
+
+/** Marks the input as source while the sections are added. */
+static const unsigned INPUT = ~0u;
+
+laproque::CrossoverFilterbank::CrossoverFilterbank( std::vector<float> co_freqs
+                                                   , unsigned sample_rate
+                                                   , crossover_type type
+                                                   , bool compensate
+                                                   )
+{
+    _crossover_freqs = co_freqs;
+    _sample_rate = sample_rate;
+    _type = type;
+    _n_bands = unsigned(co_freqs.size()) + 1;
+    
+    // Quality factors of the Butterworth sections. A Linkwitz-Riley filter is a squared Butterworth filter.
+    std::vector<float> qs;
+    if ( _type == LR4 ) {
+        qs = { 0.70710678f };
+    }
+    else {
+        qs = { 0.54119610f, 1.30656296f };
+    }
+    
+    // Split off the highest band first, like Filterbank.
+    unsigned low = INPUT;
+    unsigned high;
+    unsigned crossover, lower, repeat;
+    
+    _band_sections.resize( _n_bands );
+    
+    for ( crossover = _n_bands - 1; crossover--; ) {
+        high = low;
+        for ( repeat = 0; repeat < 2; repeat++ ) {
+            for ( float q : qs ) high = _add_section( high, crossover, _HIGH, q );
+        }
+        for ( repeat = 0; repeat < 2; repeat++ ) {
+            for ( float q : qs ) low = _add_section( low, crossover, _LOW, q );
+        }
+        
+        // The lower bands still pass the crossovers below, whose low and high pass add up to an allpass.
+        if ( compensate ) {
+            for ( lower = crossover; lower--; ) {
+                for ( float q : qs ) high = _add_section( high, lower, _ALL, q );
+            }
+        }
+        _band_sections[crossover + 1] = high;
+    }
+    _band_sections[0] = low;
+    
+    _n_sections = unsigned( _designs.size() );
+    _n_groups = std::max( (_n_sections + 3) / 4, 1u );
+    unsigned n_lanes = _n_groups * 4;
+    
+    // Unused lanes have zero coefficients and read the input.
+    _sources.resize( n_lanes, INPUT );
+    _depths.resize( n_lanes, 0.f );
+    for ( unsigned& source : _sources ) {
+        if ( source == INPUT ) source = n_lanes;
+    }
+    for ( unsigned& section : _band_sections ) {
+        if ( section == INPUT ) section = n_lanes;
+    }
+    _max_depth = unsigned( *std::max_element( _depths.begin(), _depths.end() ) );
+    
+    _coeffs.resize( _n_groups * N_COEFFS * 4 );
+    _states.resize( _n_groups * N_STATES * 4 );
+    _outputs.resize( 2 * (n_lanes + 1) );
+    _band_ptrs.resize( _n_bands );
+    
+    _update_coeffs();
+}
+
+unsigned laproque::CrossoverFilterbank::_add_section( unsigned source, unsigned crossover, _response response, float q )
+{
+    _designs.push_back( _Design{ crossover, response, q } );
+    _sources.push_back( source );
+    
+    // A section runs one sample behind its source.
+    _depths.push_back( source == INPUT ? 0.f : _depths[source] + 1.f );
+    
+    return unsigned( _designs.size() ) - 1;
+}
+
+void laproque::CrossoverFilterbank::_update_coeffs()
+{
+    for ( unsigned section = 0; section < _n_sections; section++ ) {
+        _Design& design = _designs[section];
+        float* coeffs = &_coeffs[(section / 4) * N_COEFFS * 4 + section % 4];
+        
+        // Bilinear transform with prewarped cutoff frequency.
+        double k = tan( M_PI * _crossover_freqs[design.crossover] / _sample_rate );
+        double norm = 1. / (1. + k / design.q + k * k);
+        double a1 = 2. * (k * k - 1.) * norm;
+        double a2 = (1. - k / design.q + k * k) * norm;
+        double b0, b1, b2;
+        
+        switch ( design.response ) {
+            case _LOW:
+                b0 = k * k * norm;
+                b1 = 2. * b0;
+                b2 = b0;
+                break;
+            case _HIGH:
+                b0 = norm;
+                b1 = -2. * b0;
+                b2 = b0;
+                break;
+            default:
+                b0 = a2;
+                b1 = a1;
+                b2 = 1.;
+                break;
+        }
+        
+        coeffs[0] = float(b0);
+        coeffs[4] = float(b1);
+        coeffs[8] = float(b2);
+        coeffs[12] = float(a1);
+        coeffs[16] = float(a2);
+    }
+}
+
+void laproque::CrossoverFilterbank::operator()( float in_sample, float* bands )
+{
+    for ( unsigned band = 0; band < _n_bands; band++ ) {
+        _band_ptrs[band] = bands + band;
+    }
+    process( &in_sample, &_band_ptrs[0], 1 );
+}
+
+void laproque::CrossoverFilterbank::process( float* input, float** output, unsigned long n_frames )
+{
+    _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+    
+    unsigned n_lanes = _n_groups * 4;
+    float* last = &_outputs[0];
+    float* next = &_outputs[n_lanes + 1];
+    unsigned band, group;
+    
+    // Bands without any section.
+    for ( band = 0; band < _n_bands; band++ ) {
+        if ( _band_sections[band] == n_lanes ) {
+            std::memcpy( output[band], input, n_frames * sizeof(float) );
+        }
+    }
+    
+    // The deepest sections finish the block _max_depth steps after the input.
+    unsigned long n_steps = n_frames + _max_depth;
+    
+    for ( unsigned long step = 0; step < n_steps; step++ ) {
+        last[n_lanes] = step < n_frames ? input[step] : 0.f;
+        
+        // At the start of the block the deeper sections still wait for their input,
+        // at the end the shallower ones are done. Their states must not change.
+        bool edge = step < _max_depth || step >= n_frames;
+        __m128 since_start = _mm_set1_ps( float(step) );
+        __m128 since_end = _mm_set1_ps( float(step) - float(n_frames) );
+        
+        for ( group = 0; group < _n_groups; group++ ) {
+            const unsigned* sources = &_sources[group * 4];
+            const float* coeffs = &_coeffs[group * N_COEFFS * 4];
+            float* states = &_states[group * N_STATES * 4];
+            
+            __m128 x = _mm_set_ps( last[sources[3]], last[sources[2]], last[sources[1]], last[sources[0]] );
+            __m128 s1 = _mm_loadu_ps( states );
+            __m128 s2 = _mm_loadu_ps( states + 4 );
+            
+            __m128 y = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( coeffs ), x ), s1 );
+            __m128 new_s1 = _mm_add_ps( _mm_sub_ps( _mm_mul_ps( _mm_loadu_ps( coeffs + 4 ), x ),
+                                                    _mm_mul_ps( _mm_loadu_ps( coeffs + 12 ), y ) ), s2 );
+            __m128 new_s2 = _mm_sub_ps( _mm_mul_ps( _mm_loadu_ps( coeffs + 8 ), x ),
+                                        _mm_mul_ps( _mm_loadu_ps( coeffs + 16 ), y ) );
+            
+            if ( edge ) {
+                __m128 depths = _mm_loadu_ps( &_depths[group * 4] );
+                __m128 active = _mm_and_ps( _mm_cmpge_ps( since_start, depths ), _mm_cmplt_ps( since_end, depths ) );
+                y = _mm_or_ps( _mm_and_ps( active, y ), _mm_andnot_ps( active, _mm_loadu_ps( last + group * 4 ) ) );
+                new_s1 = _mm_or_ps( _mm_and_ps( active, new_s1 ), _mm_andnot_ps( active, s1 ) );
+                new_s2 = _mm_or_ps( _mm_and_ps( active, new_s2 ), _mm_andnot_ps( active, s2 ) );
+            }
+            
+            _mm_storeu_ps( next + group * 4, y );
+            _mm_storeu_ps( states, new_s1 );
+            _mm_storeu_ps( states + 4, new_s2 );
+        }
+        
+        // Every band belongs to the sample its section is working on.
+        for ( band = 0; band < _n_bands; band++ ) {
+            unsigned section = _band_sections[band];
+            if ( section == n_lanes ) continue;
+            
+            unsigned long depth = (unsigned long)(_depths[section]);
+            if ( step >= depth && step - depth < n_frames ) {
+                output[band][step - depth] = next[section];
+            }
+        }
+        
+        std::swap( last, next );
+    }
+    
+    // Keep the latest outputs in the first set.
+    if ( last != &_outputs[0] ) {
+        std::memcpy( &_outputs[0], last, n_lanes * sizeof(float) );
+    }
+}
+
+void laproque::CrossoverFilterbank::set_co_freqs( std::vector<float> co_freqs )
+{
+    if ( co_freqs.size() == _crossover_freqs.size() ) {
+        _crossover_freqs = co_freqs;
+        _update_coeffs();
+    }
+}
+
+void laproque::CrossoverFilterbank::set_sample_rate( unsigned sample_rate )
+{
+    _sample_rate = sample_rate;
+    _update_coeffs();
+}
+
+void laproque::CrossoverFilterbank::reset()
+{
+    std::fill( _states.begin(), _states.end(), 0.f );
+    std::fill( _outputs.begin(), _outputs.end(), 0.f );
+}
+
+unsigned laproque::CrossoverFilterbank::get_n_bands()
+{
+    return _n_bands;
+}
+
+unsigned laproque::CrossoverFilterbank::get_n_sections()
+{
+    return _n_sections;
+}
@@ -10,127 +10,82 @@
 #include <algorithm>
 #include <cstring>
 
-laproque::Delay::Delay( unsigned n_delay, unsigned max_delay )
+laproque::Delay::Delay( unsigned n_delay, unsigned max_delay, PagePool* pool, sample_format format ) :
+_ring( max_delay, 1024, pool, format )
 {
     _buffer_size = max_delay;
     _n_delay = n_delay;
     
-    _buffer = new float[max_delay];
-    _buffer_end = _buffer + _buffer_size;
     reset();
 }
 
 laproque::Delay::~Delay()
 {
-    delete [] _buffer;
 }
 
 float laproque::Delay::get_one()
-{    
-    if ( _writer == _buffer_end ) _writer = _buffer;
-    if ( _reader == _buffer_end ) _reader = _buffer;
-    
-    return *_reader++;
+{
+    // The sample written next still counts towards the delay.
+    return _ring.get_sample( (unsigned long)(_n_delay) - 1 );
 }
 
 void laproque::Delay::set_one( float input )
 {
-    if ( _writer == _buffer_end ) _writer = _buffer;
-    if ( _reader == _buffer_end ) _reader = _buffer;
-    
-    *_writer++ = input;
+    _ring.write_one( input );
 }
 
 long laproque::Delay::get_delay()
 {
-    if ( _writer > _reader ) return _writer - _reader;
-    else
-    {
-        return (_writer - _buffer) + (_buffer_end - _reader);
-    }
+    return _n_delay;
 }
 
 float laproque::Delay::operator()( float input )
 {
-    if ( _writer == _buffer_end ) _writer = _buffer;
-    if ( _reader == _buffer_end ) _reader = _buffer;
-    
-    *_writer++ = input;
-    return *_reader++;
+    _ring.write_one( input );
+    return _ring.get_sample( (unsigned long)(_n_delay) );
 }
 
 void laproque::Delay::process( float *input, float* output, unsigned long n_samples )
 {
-    // There is nothing to do when the delay is 0.
-    if ( _n_delay == 0 ) {
-        memcpy( output, input, n_samples*sizeof(float) );
-        return;
-    }
-    
     _n_remaining = long(n_samples);
     
     while ( _n_remaining ) {
         
-        // Check if writer is in front of reader.
-        if ( _writer > _reader ) {
-            // Only copy until writer reaches _buffer end.
-            _n_ready = std::min( _n_remaining, _buffer_end - _writer );
-        }
-        else {
-            // Only copy until reader reaches buffer end.
-            _n_ready = std::min( _n_remaining, _buffer_end - _reader );
-        }
-        
-        // Only copy until new input is needed.
-        _n_ready = std::min( _n_ready, _n_delay );
-        
-        std::memcpy( output, _reader, unsigned(_n_ready)*sizeof(float) );
-        _reader += _n_ready;
+        // Only process as many samples as can be read in one piece.
+        _n_ready = std::min( _n_remaining, ptrdiff_t(_ring.get_max_block()) );
         
-        std::memcpy( _writer, input, unsigned(_n_ready)*sizeof(float) );
-        _writer += _n_ready;
+        // Writing first also allows delays shorter than the block.
+        _ring.write( input, (unsigned long)(_n_ready) );
+        _ring.read_block( (unsigned long)(_n_delay), (unsigned long)(_n_ready), output );
         
         _n_remaining -= _n_ready;
-
-        if ( _writer  == _buffer_end ) _writer = _buffer;
-        if ( _reader  == _buffer_end ) _reader = _buffer;
         
         input += _n_ready;
         output += _n_ready;
     }
 }
 
+unsigned laproque::Delay::get_spans( unsigned long delay, unsigned long n_frames, const float** spans, unsigned long* lengths )
+{
+    return _ring.get_spans( delay, n_frames, spans, lengths );
+}
+
 void laproque::Delay::set_delay( long new_delay )
 {
     if ( new_delay < _buffer_size) {
-        _reader = _writer - new_delay;
-        if ( _reader < _buffer ) _reader += _buffer_size;
-        
         _n_delay = new_delay;
     }
 }
 
 void laproque::Delay::reset()
 {
-    for ( int idx = 0; idx < _buffer_size; idx++ )
-    {
-        _buffer[idx] = 0.f;
-    }
-
-    _reader = _buffer;
-    _writer = _buffer + _n_delay;
+    _ring.reset();
 }
 
 void laproque::Delay::replace_buffer( float *sample_data, unsigned int n_frames )
 {
     // Check if n_frames exceeds buffer size.
     if ( ptrdiff_t(n_frames) <= _buffer_size) {
-        
-        ptrdiff_t part1 = _buffer_end - _writer;
-        if ( part1 > ptrdiff_t(n_frames) ) {
-            part1 = n_frames;
-        }
-        memcpy( _writer, sample_data, (unsigned long)part1 * sizeof(float) );
-        memcpy( _buffer, sample_data+part1, (unsigned long)(n_frames-part1) * sizeof(float) );
+        _ring.replace( sample_data, n_frames );
     }
 }
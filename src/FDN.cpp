@@ -0,0 +1,314 @@
+//
+//  FDN.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "FDN.hpp"
+#include "Filter.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <math.h>
+
+#include <pmmintrin.h>
+
+const unsigned long laproque::FDN::BLOCK;
+
+static inline float horizontal_sum( __m128 values )
+{
+    values = _mm_add_ps( values, _mm_movehl_ps( values, values ) );
+    values = _mm_add_ss( values, _mm_shuffle_ps( values, values, 1 ) );
+    return _mm_cvtss_f32( values );
+}
+
+static bool is_prime( unsigned long value )
+{
+    if ( value < 2 ) return false;
+    for ( unsigned long div = 2; div*div <= value; div++ ) {
+        if ( value % div == 0 ) return false;
+    }
+    return true;
+}
+
+laproque::FDN::FDN( unsigned n_lines, unsigned max_delay, unsigned sample_rate, mixing_matrix mixing )
+{
+    _sample_rate = sample_rate;
+    _mixing = mixing;
+    
+    n_lines = std::min( std::max( n_lines, 8u ), 64u );
+    if ( _mixing == HADAMARD ) {
+        _n_lines = 8;
+        while ( _n_lines < n_lines ) _n_lines <<= 1;
+    }
+    else {
+        _n_lines = (n_lines + 3) & ~3u;
+    }
+    
+    _delays.resize( _n_lines );
+    
+    // Mutually prime line lengths spread exponentially between 7 and 47 ms. The range shrinks
+    // with the same ratio if it does not fit into max_delay, so the lengths stay distinct.
+    max_delay = std::max( max_delay, 2u );
+    float max_time = std::min( 0.047f, 0.95f * float(max_delay - 1) / float(_sample_rate) );
+    unsigned long last_delay = 1;
+    for ( unsigned line = 0; line < _n_lines; line++ ) {
+        float time = max_time * 7.f / 47.f * powf( 47.f / 7.f, float(line) / float(_n_lines - 1) );
+        unsigned long delay = std::max( (unsigned long)(time * _sample_rate), last_delay + 1 );
+        while ( !is_prime( delay ) ) delay++;
+        
+        _delays[line] = delay;
+        last_delay = delay;
+    }
+    
+    // Too few primes below a very short max_delay. The lines grow rather than sharing a length.
+    _max_delay = std::max( (unsigned long)(max_delay), last_delay );
+    
+    _offsets.resize( _n_lines );
+    _positions.resize( _n_lines );
+    _b0.resize( _n_lines );
+    _b1.resize( _n_lines );
+    _a1.resize( _n_lines );
+    _in_state.resize( _n_lines );
+    _out_state.resize( _n_lines );
+    _in_gains.resize( _n_lines );
+    _out_gains.resize( _n_lines );
+    _line_block.resize( _n_lines * BLOCK );
+    _frames.resize( BLOCK * _n_lines );
+    
+    // Alternating output signs decorrelate the lines in the sum.
+    float gain = 1.f / sqrtf( float(_n_lines) );
+    for ( unsigned line = 0; line < _n_lines; line++ ) {
+        _in_gains[line] = gain;
+        _out_gains[line] = line % 2 ? -gain : gain;
+    }
+    
+    _allocate_lines();
+    _compute_coeffs();
+}
+
+void laproque::FDN::_allocate_lines()
+{
+    unsigned long n_samples = 0;
+    for ( unsigned line = 0; line < _n_lines; line++ ) {
+        _offsets[line] = n_samples;
+        n_samples += _delays[line];
+    }
+    _history.resize( n_samples );
+    
+    // A block must not read samples it writes itself.
+    _block_size = std::min( BLOCK, *std::min_element( _delays.begin(), _delays.end() ) );
+    
+    reset();
+}
+
+void laproque::FDN::process( float* input, float* output, unsigned long n_frames )
+{
+    _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+    
+    // The Hadamard matrix is scaled when writing back to make it orthogonal.
+    const __m128 mix_gain = _mm_set1_ps( _mixing == HADAMARD ? 1.f / sqrtf( float(_n_lines) ) : 1.f );
+    
+    unsigned line;
+    unsigned long frame;
+    unsigned long n_done = 0;
+    
+    while ( n_done < n_frames ) {
+        unsigned long n_ready = std::min( n_frames - n_done, _block_size );
+        
+        // Frames are transposed in groups of four. The blocks have room for the padding.
+        unsigned long n_padded = (n_ready + 3) & ~3lu;
+        
+        // Line outputs. Every line is read contiguously, wrapping at most once.
+        for ( line = 0; line < _n_lines; line++ ) {
+            const float* history = &_history[ _offsets[line] ];
+            float* block = &_line_block[ line * BLOCK ];
+            unsigned long first = std::min( n_ready, _delays[line] - _positions[line] );
+            
+            std::memcpy( block, history + _positions[line], first*sizeof(float) );
+            std::memcpy( block + first, history, (n_ready - first)*sizeof(float) );
+        }
+        
+        for ( line = 0; line < _n_lines; line += 4 ) {
+            for ( frame = 0; frame < n_padded; frame += 4 ) {
+                __m128 row0 = _mm_loadu_ps( &_line_block[ line * BLOCK + frame ] );
+                __m128 row1 = _mm_loadu_ps( &_line_block[ (line + 1) * BLOCK + frame ] );
+                __m128 row2 = _mm_loadu_ps( &_line_block[ (line + 2) * BLOCK + frame ] );
+                __m128 row3 = _mm_loadu_ps( &_line_block[ (line + 3) * BLOCK + frame ] );
+                _MM_TRANSPOSE4_PS( row0, row1, row2, row3 );
+                _mm_storeu_ps( &_frames[ frame * _n_lines + line ], row0 );
+                _mm_storeu_ps( &_frames[ (frame + 1) * _n_lines + line ], row1 );
+                _mm_storeu_ps( &_frames[ (frame + 2) * _n_lines + line ], row2 );
+                _mm_storeu_ps( &_frames[ (frame + 3) * _n_lines + line ], row3 );
+            }
+        }
+        
+        for ( frame = 0; frame < n_ready; frame++ ) {
+            float* values = &_frames[ frame * _n_lines ];
+            
+            // Damping and output sum.
+            __m128 out_sum = _mm_setzero_ps();
+            for ( line = 0; line < _n_lines; line += 4 ) {
+                __m128 in = _mm_loadu_ps( values + line );
+                __m128 out = _mm_mul_ps( in, _mm_loadu_ps( &_b0[line] ) );
+                out = _mm_add_ps( out, _mm_mul_ps( _mm_loadu_ps( &_in_state[line] ), _mm_loadu_ps( &_b1[line] ) ) );
+                out = _mm_sub_ps( out, _mm_mul_ps( _mm_loadu_ps( &_out_state[line] ), _mm_loadu_ps( &_a1[line] ) ) );
+                
+                _mm_storeu_ps( &_in_state[line], in );
+                _mm_storeu_ps( &_out_state[line], out );
+                _mm_storeu_ps( values + line, out );
+                
+                out_sum = _mm_add_ps( out_sum, _mm_mul_ps( out, _mm_loadu_ps( &_out_gains[line] ) ) );
+            }
+            output[n_done + frame] = horizontal_sum( out_sum );
+            
+            _mix( values );
+            
+            // Feed back together with the input.
+            __m128 in = _mm_set1_ps( input[n_done + frame] );
+            for ( line = 0; line < _n_lines; line += 4 ) {
+                __m128 value = _mm_mul_ps( _mm_loadu_ps( values + line ), mix_gain );
+                value = _mm_add_ps( value, _mm_mul_ps( in, _mm_loadu_ps( &_in_gains[line] ) ) );
+                _mm_storeu_ps( values + line, value );
+            }
+        }
+        
+        for ( line = 0; line < _n_lines; line += 4 ) {
+            for ( frame = 0; frame < n_padded; frame += 4 ) {
+                __m128 row0 = _mm_loadu_ps( &_frames[ frame * _n_lines + line ] );
+                __m128 row1 = _mm_loadu_ps( &_frames[ (frame + 1) * _n_lines + line ] );
+                __m128 row2 = _mm_loadu_ps( &_frames[ (frame + 2) * _n_lines + line ] );
+                __m128 row3 = _mm_loadu_ps( &_frames[ (frame + 3) * _n_lines + line ] );
+                _MM_TRANSPOSE4_PS( row0, row1, row2, row3 );
+                _mm_storeu_ps( &_line_block[ line * BLOCK + frame ], row0 );
+                _mm_storeu_ps( &_line_block[ (line + 1) * BLOCK + frame ], row1 );
+                _mm_storeu_ps( &_line_block[ (line + 2) * BLOCK + frame ], row2 );
+                _mm_storeu_ps( &_line_block[ (line + 3) * BLOCK + frame ], row3 );
+            }
+        }
+        
+        // The fed back block replaces the one just read.
+        for ( line = 0; line < _n_lines; line++ ) {
+            float* history = &_history[ _offsets[line] ];
+            const float* block = &_line_block[ line * BLOCK ];
+            unsigned long first = std::min( n_ready, _delays[line] - _positions[line] );
+            
+            std::memcpy( history + _positions[line], block, first*sizeof(float) );
+            std::memcpy( history, block + first, (n_ready - first)*sizeof(float) );
+            
+            _positions[line] += n_ready;
+            if ( _positions[line] >= _delays[line] ) _positions[line] -= _delays[line];
+        }
+        
+        n_done += n_ready;
+    }
+}
+
+void laproque::FDN::_mix( float* frame )
+{
+    unsigned line;
+    
+    if ( _mixing == HADAMARD ) {
+        
+        // First two butterfly stages inside each group of four lines.
+        const __m128 sign1 = _mm_set_ps( -1.f, 1.f, -1.f, 1.f );
+        const __m128 sign2 = _mm_set_ps( -1.f, -1.f, 1.f, 1.f );
+        for ( line = 0; line < _n_lines; line += 4 ) {
+            __m128 values = _mm_loadu_ps( frame + line );
+            values = _mm_add_ps( _mm_mul_ps( values, sign1 ), _mm_shuffle_ps( values, values, _MM_SHUFFLE(2, 3, 0, 1) ) );
+            values = _mm_add_ps( _mm_mul_ps( values, sign2 ), _mm_shuffle_ps( values, values, _MM_SHUFFLE(1, 0, 3, 2) ) );
+            _mm_storeu_ps( frame + line, values );
+        }
+        
+        // Remaining stages between groups.
+        for ( unsigned half = 4; half < _n_lines; half <<= 1 ) {
+            for ( unsigned start = 0; start < _n_lines; start += 2*half ) {
+                for ( line = start; line < start + half; line += 4 ) {
+                    __m128 upper = _mm_loadu_ps( frame + line );
+                    __m128 lower = _mm_loadu_ps( frame + line + half );
+                    _mm_storeu_ps( frame + line, _mm_add_ps( upper, lower ) );
+                    _mm_storeu_ps( frame + line + half, _mm_sub_ps( upper, lower ) );
+                }
+            }
+        }
+    }
+    else {
+        
+        // I - 2/N * ones
+        __m128 sum = _mm_setzero_ps();
+        for ( line = 0; line < _n_lines; line += 4 ) {
+            sum = _mm_add_ps( sum, _mm_loadu_ps( frame + line ) );
+        }
+        __m128 reflection = _mm_set1_ps( -2.f / float(_n_lines) * horizontal_sum( sum ) );
+        
+        for ( line = 0; line < _n_lines; line += 4 ) {
+            _mm_storeu_ps( frame + line, _mm_add_ps( _mm_loadu_ps( frame + line ), reflection ) );
+        }
+    }
+}
+
+void laproque::FDN::set_delays( unsigned long* delays )
+{
+    for ( unsigned line = 0; line < _n_lines; line++ ) {
+        _delays[line] = std::min( std::max( delays[line], 1lu ), _max_delay );
+    }
+    _allocate_lines();
+    _compute_coeffs();
+}
+
+void laproque::FDN::set_rt60( float rt60_low, float rt60_high, float crossover_freq )
+{
+    _rt60_low = rt60_low;
+    _rt60_high = rt60_high;
+    _crossover_freq = crossover_freq;
+    _compute_coeffs();
+}
+
+void laproque::FDN::set_input_gains( float* gains )
+{
+    std::copy( gains, gains + _n_lines, _in_gains.begin() );
+}
+
+void laproque::FDN::set_output_gains( float* gains )
+{
+    std::copy( gains, gains + _n_lines, _out_gains.begin() );
+}
+
+void laproque::FDN::_compute_coeffs()
+{
+    // Low and high pass with equal cutoff sum to 1, weighting them gives a shelving filter.
+    float low_b[2], low_a[2], high_b[2], high_a[2];
+    Filter( LOW, _crossover_freq, _sample_rate ).get_coeffs( low_b, low_a );
+    Filter( HIGH, _crossover_freq, _sample_rate ).get_coeffs( high_b, high_a );
+    
+    for ( unsigned line = 0; line < _n_lines; line++ ) {
+        
+        // -60 dB after rt60 seconds.
+        float low_gain = powf( 10.f, -3.f * _delays[line] / (_rt60_low * _sample_rate) );
+        float high_gain = powf( 10.f, -3.f * _delays[line] / (_rt60_high * _sample_rate) );
+        
+        _b0[line] = low_gain * low_b[0] + high_gain * high_b[0];
+        _b1[line] = low_gain * low_b[1] + high_gain * high_b[1];
+        _a1[line] = low_a[1];
+    }
+}
+
+void laproque::FDN::reset()
+{
+    std::fill( _history.begin(), _history.end(), 0.f );
+    std::fill( _in_state.begin(), _in_state.end(), 0.f );
+    std::fill( _out_state.begin(), _out_state.end(), 0.f );
+    std::fill( _positions.begin(), _positions.end(), 0lu );
+}
+
+unsigned laproque::FDN::get_n_lines()
+{
+    return _n_lines;
+}
+
+unsigned long laproque::FDN::get_delay( unsigned line )
+{
+    return _delays[line];
+}
@@ -0,0 +1,214 @@
+//
+//  FFTFilterbank.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.
+//
+
+#include "FFTFilterbank.hpp"
+#include <math.h>
+#include <algorithm>
+#include <cstring>
+
+laproque::FFTFilterbank::FFTFilterbank(
+                                       std::vector<float> co_freqs
+                                       , unsigned sample_rate
+                                       , unsigned fft_size
+                                       ) :
+_fft( fft_size )
+{
+    _crossover_freqs = co_freqs;
+    _sample_rate = sample_rate;
+    _n_bands = unsigned(co_freqs.size()) + 1;
+
+    _fft_size = fft_size;
+    _hop_size = fft_size / 4;
+    _spectrum_size = _fft.get_spetrum_size();
+
+    // Square root of a periodic Hann window. Four overlapping squares add up to 2.
+    _window.resize( _fft_size );
+    for ( unsigned idx = 0; idx < _fft_size; idx++ ) {
+        _window[idx] = sinf( float(M_PI) * idx / _fft_size );
+    }
+
+    _frame = fftwf_alloc_real( _fft_size );
+    _spectrum = fftwf_alloc_complex( _spectrum_size );
+    _band_spectrum = fftwf_alloc_complex( _spectrum_size );
+
+    _masks.resize( _n_bands, std::vector<float>( _spectrum_size ) );
+    _first_bins.resize( _n_bands );
+    _last_bins.resize( _n_bands );
+    _bin_gains.resize( _spectrum_size );
+    _band_weights.resize( _n_bands, 1.f );
+
+    _input.resize( _fft_size );
+    _band_overlaps.resize( _n_bands, std::vector<float>( _fft_size ) );
+    _mix_overlap.resize( _fft_size );
+
+    _update_masks();
+    reset();
+}
+
+laproque::FFTFilterbank::~FFTFilterbank()
+{
+    fftwf_free( _frame );
+    fftwf_free( _spectrum );
+    fftwf_free( _band_spectrum );
+}
+
+void laproque::FFTFilterbank::_update_masks()
+{
+    // Share of each bin above a crossover, fading over one bin. Band masks are differences of these
+    // shares, so they add up to one whatever the distance of the crossovers.
+    std::vector<float> above_lower( _spectrum_size, 1.f );
+    std::vector<float> above_upper( _spectrum_size );
+
+    for ( unsigned band = 0; band < _n_bands; band++ ) {
+        if ( band + 1 < _n_bands ) {
+            float position = _crossover_freqs[band] * _fft_size / _sample_rate;
+            for ( unsigned bin = 0; bin < _spectrum_size; bin++ ) {
+                above_upper[bin] = std::min( std::max( bin - position + 0.5f, 0.f ), 1.f );
+            }
+        }
+        else {
+            std::fill( above_upper.begin(), above_upper.end(), 0.f );
+        }
+
+        _first_bins[band] = _spectrum_size;
+        _last_bins[band] = 0;
+        for ( unsigned bin = 0; bin < _spectrum_size; bin++ ) {
+            _masks[band][bin] = above_lower[bin] - above_upper[bin];
+            if ( _masks[band][bin] != 0.f ) {
+                _first_bins[band] = std::min( _first_bins[band], bin );
+                _last_bins[band] = bin + 1;
+            }
+        }
+        _first_bins[band] = std::min( _first_bins[band], _last_bins[band] );
+
+        above_lower.swap( above_upper );
+    }
+
+    _update_gains();
+}
+
+void laproque::FFTFilterbank::_update_gains()
+{
+    std::fill( _bin_gains.begin(), _bin_gains.end(), 0.f );
+    for ( unsigned band = 0; band < _n_bands; band++ ) {
+        for ( unsigned bin = _first_bins[band]; bin < _last_bins[band]; bin++ ) {
+            _bin_gains[bin] += _band_weights[band] * _masks[band][bin];
+        }
+    }
+}
+
+void laproque::FFTFilterbank::process( float* input, float** output, unsigned long n_frames )
+{
+    unsigned long n_ready;
+
+    for ( unsigned long done = 0; done < n_frames; done += n_ready ) {
+        n_ready = std::min( n_frames - done, (unsigned long)(_hop_size - _hop_fill) );
+
+        memcpy( &_input[_fft_size - _hop_size + _hop_fill], input + done, n_ready * sizeof(float) );
+        for ( unsigned band = 0; band < _n_bands; band++ ) {
+            memcpy( output[band] + done, &_band_overlaps[band][_hop_fill], n_ready * sizeof(float) );
+        }
+        _hop_fill += n_ready;
+
+        if ( _hop_fill == _hop_size ) {
+            _analyse();
+            for ( unsigned band = 0; band < _n_bands; band++ ) {
+                memset( _band_spectrum, 0, _spectrum_size * sizeof(fftwf_complex) );
+                for ( unsigned bin = _first_bins[band]; bin < _last_bins[band]; bin++ ) {
+                    _band_spectrum[bin][0] = _spectrum[bin][0] * _masks[band][bin];
+                    _band_spectrum[bin][1] = _spectrum[bin][1] * _masks[band][bin];
+                }
+                _synthesise( _band_spectrum, _band_overlaps[band] );
+            }
+            _hop_fill = 0;
+        }
+    }
+}
+
+void laproque::FFTFilterbank::process_mix( float* input, float* output, unsigned long n_frames )
+{
+    unsigned long n_ready;
+
+    for ( unsigned long done = 0; done < n_frames; done += n_ready ) {
+        n_ready = std::min( n_frames - done, (unsigned long)(_hop_size - _hop_fill) );
+
+        memcpy( &_input[_fft_size - _hop_size + _hop_fill], input + done, n_ready * sizeof(float) );
+        memcpy( output + done, &_mix_overlap[_hop_fill], n_ready * sizeof(float) );
+        _hop_fill += n_ready;
+
+        if ( _hop_fill == _hop_size ) {
+            _analyse();
+            for ( unsigned bin = 0; bin < _spectrum_size; bin++ ) {
+                _spectrum[bin][0] *= _bin_gains[bin];
+                _spectrum[bin][1] *= _bin_gains[bin];
+            }
+            _synthesise( _spectrum, _mix_overlap );
+            _hop_fill = 0;
+        }
+    }
+}
+
+void laproque::FFTFilterbank::_analyse()
+{
+    for ( unsigned idx = 0; idx < _fft_size; idx++ ) {
+        _frame[idx] = _input[idx] * _window[idx];
+    }
+    _fft.real2complex( _frame, _spectrum );
+
+    // Make room for the next hop.
+    memmove( &_input[0], &_input[_hop_size], (_fft_size - _hop_size) * sizeof(float) );
+}
+
+void laproque::FFTFilterbank::_synthesise( fftwf_complex* spectrum, std::vector<float>& overlap )
+{
+    _fft.complex2real( spectrum, _frame );
+
+    // The first hop was output already.
+    memmove( &overlap[0], &overlap[_hop_size], (_fft_size - _hop_size) * sizeof(float) );
+    std::fill( overlap.end() - _hop_size, overlap.end(), 0.f );
+
+    for ( unsigned idx = 0; idx < _fft_size; idx++ ) {
+        overlap[idx] += 0.5f * _window[idx] * _frame[idx];
+    }
+}
+
+void laproque::FFTFilterbank::set_band_weights( std::vector<float> weights )
+{
+    if ( weights.size() == _n_bands ) {
+        _band_weights = weights;
+        _update_gains();
+    }
+}
+
+void laproque::FFTFilterbank::set_co_freqs( std::vector<float> co_freqs )
+{
+    if ( co_freqs.size() == _crossover_freqs.size() ) {
+        _crossover_freqs = co_freqs;
+        _update_masks();
+    }
+}
+
+void laproque::FFTFilterbank::reset()
+{
+    std::fill( _input.begin(), _input.end(), 0.f );
+    for ( unsigned band = 0; band < _n_bands; band++ ) {
+        std::fill( _band_overlaps[band].begin(), _band_overlaps[band].end(), 0.f );
+    }
+    std::fill( _mix_overlap.begin(), _mix_overlap.end(), 0.f );
+    _hop_fill = 0;
+}
+
+unsigned laproque::FFTFilterbank::get_n_bands()
+{
+    return _n_bands;
+}
+
+unsigned long laproque::FFTFilterbank::get_latency()
+{
+    return _fft_size;
+}
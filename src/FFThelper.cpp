@@ -11,7 +11,7 @@
 #include <math.h>
 #include <cstring>
 
-laproque::FFThelper::FFThelper( unsigned size ) :
+laproque::FFThelper::FFThelper( unsigned size, unsigned planner_flags ) :
 _fft_size(size + (size % 2)),
 _spectrum_size(size/2 + 1)
 {
@@ -21,8 +21,8 @@ _spectrum_size(size/2 + 1)
     _time_domain = fftwf_alloc_real( _fft_size );
     _freq_domain = fftwf_alloc_complex( _spectrum_size );
     
-    _fft_plan = fftwf_plan_dft_r2c_1d( int(_fft_size), _time_domain, _freq_domain, 0 );
-    _ifft_plan = fftwf_plan_dft_c2r_1d( int(_fft_size), _freq_domain, _time_domain, 0 );
+    _fft_plan = fftwf_plan_dft_r2c_1d( int(_fft_size), _time_domain, _freq_domain, planner_flags );
+    _ifft_plan = fftwf_plan_dft_c2r_1d( int(_fft_size), _freq_domain, _time_domain, planner_flags );
     
 }
 
@@ -20,7 +20,9 @@ laproque::FadingDelay::FadingDelay( unsigned long fade_length, unsigned delay, u
     
     _setup_fades();
     
-    }
+    _next_delay = _old_delay = delay;
+    _to_fade = 0;
+}
 
 
 void laproque::FadingDelay::process( float *input, float *output, unsigned long n_samples )
@@ -29,52 +31,45 @@ void laproque::FadingDelay::process( float *input, float *output, unsigned long
     
     if ( _has_changed.load() )
     {
-        _old_reader = _reader;
-        
-        _reader =  _writer  - _n_delay;
-        if ( _reader < _buffer ) _reader += _buffer_size;
+        _old_delay = _n_delay;
+        _n_delay = _next_delay;
         
         _to_fade = _fade_length;
         _has_changed.store( false );
     }
     
-    if ( _to_fade )
+    while ( _to_fade && _n_remaining )
     {
-        unsigned long fade_now = std::min( n_samples,  _to_fade );
+        _n_ready = std::min( _n_remaining, ptrdiff_t(_ring.get_max_block()) );
+        _n_ready = std::min( _n_ready, ptrdiff_t(_to_fade) );
+        
+        _ring.write( input, (unsigned long)(_n_ready) );
+        
+        const float* new_samples = _ring.get_block( (unsigned long)(_n_delay), (unsigned long)(_n_ready) );
+        const float* fadein = _fadein_buf + (_fade_length - _to_fade);
         
         if ( _fade_out.load() ) {
-            for ( unsigned long idx = 0; idx < fade_now; idx++ )
+            const float* old_samples = _ring.get_block( (unsigned long)(_old_delay), (unsigned long)(_n_ready) );
+            const float* fadeout = _fadeout_buf + (_fade_length - _to_fade);
+            
+            for ( long idx = 0; idx < _n_ready; idx++ )
             {
-                output[idx] = (*_old_reader++) * (*_fadeout_buf++);
-                output[idx] += operator()( input[idx] ) *  (*_fadein_buf++);
-                
-                if ( _old_reader >= _buffer_end ) _old_reader -= _buffer_size;
+                output[idx] = old_samples[idx] * fadeout[idx] + new_samples[idx] * fadein[idx];
             }
         }
         
         else {
-            for ( unsigned long idx = 0; idx < fade_now; idx++ )
+            for ( long idx = 0; idx < _n_ready; idx++ )
             {
-                output[idx] = operator()( input[idx] ) *  (*_fadein_buf++);
+                output[idx] = new_samples[idx] * fadein[idx];
             }
         }
         
-        _n_remaining -= fade_now;
-        _to_fade -= fade_now;
+        _n_remaining -= _n_ready;
+        _to_fade -= (unsigned long)(_n_ready);
         
-        // Check if fading is completed in this process call and adjust buffers in case.
-        if ( _to_fade == 0 )
-        {
-            _fadein_buf -= _fade_length;
-            
-            if ( _fade_out.load() ) {
-                _fadeout_buf -= _fade_length;
-            }
-            
-            
-            output += fade_now;
-            input += fade_now;
-        }
+        input += _n_ready;
+        output += _n_ready;
     }
     
     Delay::process( input, output, (unsigned long)(_n_remaining) );
@@ -83,8 +78,8 @@ void laproque::FadingDelay::process( float *input, float *output, unsigned long
 void laproque::FadingDelay::set_delay( long new_delay )
 {
     if ( new_delay < _buffer_size) {
+        _next_delay = new_delay;
         _has_changed.store( true );
-        _n_delay = new_delay;
     }
 }
 
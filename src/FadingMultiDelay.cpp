@@ -12,20 +12,31 @@
 
 #include "FadingMultiDelay.hpp"
 
-const unsigned laproque::FadingMultiDelay::N_DELAYS_MAX;
+const unsigned laproque::FadingMultiDelay::NO_TAP;
+const unsigned laproque::FadingMultiDelay::NEW_SET;
+const unsigned laproque::FadingMultiDelay::MIN_TAPS_PER_PART;
 
-laproque::FadingMultiDelay::FadingMultiDelay( unsigned max_delay ) :
-_buffer_size( max_delay )
+laproque::FadingMultiDelay::FadingMultiDelay( unsigned max_delay, unsigned max_n_delays, unsigned n_threads, PagePool* pool, sample_format format ) :
+_buffer_size( max_delay ), _ring( max_delay, 1024, pool, format ),
+_max_n_delays( max_n_delays ), _max_n_taps( 2 * max_n_delays )
 {
-    _buffer = new float[max_delay];
-    _core_buffer = new float[max_delay];
-    _buffer_end = _buffer + _buffer_size + 1;
-    _min_delay = max_delay;
-    _writer = _buffer;
+    // All storage is allocated here, so processing never reallocates.
+    for ( unsigned set = 0; set < 3; set++ ) {
+        _sets[set].delays.resize( _max_n_delays );
+        _sets[set].weights.resize( _max_n_delays );
+    }
+    _delay_taps.assign( _max_n_delays, NO_TAP );
+    
+    _tap_delays.resize( _max_n_taps );
+    _tap_weights.resize( _max_n_taps );
+    _tap_old_weights.resize( _max_n_taps );
+    _tap_to_fade.resize( _max_n_taps );
+    _tap_status.resize( _max_n_taps );
+    _tap_owners.resize( _max_n_taps );
     
-    for ( unsigned dly = 0; dly < N_DELAYS_MAX; ++dly ) {
-        _delays[dly] = _DelayCore( _buffer, _buffer_end, 0, &_writer );
-        _delays[dly].set_status( DEAD );
+    if ( n_threads > 1 ) {
+        _pool = new WorkerPool( n_threads );
+        _partials.resize( (n_threads-1) * _ring.get_max_block() );
     }
     
     reset();
@@ -33,64 +44,117 @@ _buffer_size( max_delay )
 
 laproque::FadingMultiDelay::~FadingMultiDelay()
 {
-    delete [] _buffer;
-    delete [] _core_buffer;
+    delete _pool;
 }
 
 void laproque::FadingMultiDelay::process( float *input, float *output, unsigned long n_frames )
 {
-    if ( _has_changed.load() ) {
+    if ( _latest_set.load() & NEW_SET ) {
+        _front_set = _latest_set.exchange( _front_set ) & ~NEW_SET;
         _update();
     }
-    
-    unsigned idx;
-    
-    // Set output to 0
-    for ( idx = 0; idx < n_frames; idx++ ) {
-        output[idx] = 0.f;
+    else if ( _update_pending ) {
+        _update();
     }
     
     _n_remaining = n_frames;
-    FadeBehavior status;
     
-    //printf("Processing %u Delays\n", _n_delays);
     while ( _n_remaining )
     {
-        _n_ready = std::min( _min_delay, _n_remaining );
-        _n_ready = std::min( _n_ready, (unsigned long)(_buffer_end - _writer) );
+        // Only process as many samples as can be read in one piece.
+        _n_ready = std::min( _ring.get_max_block(), _n_remaining );
         
-       //printf("- Main Process needs: %lu, min %lu -\n", _n_ready, _min_delay);
-
-        for ( unsigned dly = 0; dly < _n_delays; dly++) {
-            //printf("-> Processing Delay %u\n", dly);
-            status = _delays[dly].get_status();
-            if ( status == DEAD ) {
-                continue;
-            }
-            _delays[dly].process( _core_buffer, _n_ready );
+        _ring.write( input, _n_ready );
+        
+        // Only split the taps if every part gets enough of them.
+        _n_parts = 1;
+        if ( _pool ) {
+            _n_parts = std::min( _pool->get_n_workers(), std::max( _n_taps / MIN_TAPS_PER_PART, 1u ) );
+        }
+        
+        if ( _n_parts > 1 ) {
+            _part_output = output;
+            _pool->run( _process_part, this );
             
-            for ( idx = 0; idx < _n_ready; idx++ ) {
-                output[idx] += _core_buffer[idx];
+            // Sum up the parts in fixed order, so the result does not depend on thread timing.
+            for ( unsigned part = 1; part < _n_parts; part++ ) {
+                float* partial = &_partials[(part-1) * _ring.get_max_block()];
+                for ( unsigned long idx = 0; idx < _n_ready; idx++ ) {
+                    output[idx] += partial[idx];
+                }
             }
         }
-
-        memcpy( _writer, input, _n_ready*sizeof(float) );
+        else {
+            _process_taps( 0, _n_taps, output );
+        }
+        
+        _remove_dead_taps();
         
         input += _n_ready;
         output += _n_ready;
         
-        _writer += _n_ready;
-        if ( _writer == _buffer_end) _writer = _buffer;
-        
         _n_remaining -= _n_ready;
-        
     }
+}
+
+unsigned laproque::FadingMultiDelay::get_spans( unsigned long delay, unsigned long n_frames, const float** spans, unsigned long* lengths )
+{
+    return _ring.get_spans( delay, n_frames, spans, lengths );
+}
+
+void laproque::FadingMultiDelay::_process_part( void* instance, unsigned part )
+{
+    FadingMultiDelay* fmd = (FadingMultiDelay*)instance;
+    if ( part >= fmd->_n_parts ) return;
     
-    output -= n_frames;
-    _n_delays = _new_n_delays;
-    _update_min_delay();
+    unsigned begin = unsigned( (unsigned long)fmd->_n_taps * part / fmd->_n_parts );
+    unsigned end = unsigned( (unsigned long)fmd->_n_taps * (part+1) / fmd->_n_parts );
     
-    _has_changed.store( false );
+    float* output = fmd->_part_output;
+    if ( part ) output = &fmd->_partials[(part-1) * fmd->_ring.get_max_block()];
+    
+    fmd->_process_taps( begin, end, output );
+}
+
+void laproque::FadingMultiDelay::_process_taps( unsigned begin, unsigned end, float* output )
+{
+    unsigned long idx;
+    
+    // Set output to 0
+    for ( idx = 0; idx < _n_ready; idx++ ) {
+        output[idx] = 0.f;
+    }
+    
+    // Accumulate all taps directly into the output.
+    float gains[N_FADE];
+    
+    for ( unsigned tap = begin; tap < end; tap++ ) {
+        float weight = _tap_weights[tap];
+        unsigned long fade_now = 0;
+        
+        if ( _tap_to_fade[tap] ) {
+            fade_now = std::min( _tap_to_fade[tap], _n_ready );
+            const float* fadein = fade_in + (N_FADE - _tap_to_fade[tap]);
+            const float* fadeout = fade_out + (N_FADE - _tap_to_fade[tap]);
+            float old_weight = _tap_old_weights[tap];
+            
+            for ( idx = 0; idx < fade_now; idx++ ) {
+                gains[idx] = old_weight * fadeout[idx] + weight * fadein[idx];
+            }
+            
+            // The fading part is the start of the block, i.e. further in the past.
+            _ring.add_block( _tap_delays[tap] + (_n_ready - fade_now), fade_now, gains, output );
+            
+            _tap_to_fade[tap] -= fade_now;
+            if ( _tap_to_fade[tap] == 0 ) {
+                _tap_status[tap] = _tap_status[tap] == DYING ? DEAD : ALIVE;
+            }
+        }
+        
+        if ( fade_now < _n_ready ) {
+            _ring.add_block( _tap_delays[tap], _n_ready - fade_now, weight, output + fade_now );
+        }
+    }
 }
 
 unsigned laproque::FadingMultiDelay::get_n_delays()
@@ -98,300 +162,206 @@ unsigned laproque::FadingMultiDelay::get_n_delays()
     return _n_delays;
 }
 
+unsigned laproque::FadingMultiDelay::get_max_n_delays()
+{
+    return _max_n_delays;
+}
+
 void laproque::FadingMultiDelay::kill_last()
 {
     if (_n_delays) {
-        _delays[_n_delays-1].set_status( DYING );
+        _n_delays--;
+        _kill_tap( _delay_taps[_n_delays] );
+        _delay_taps[_n_delays] = NO_TAP;
     }
 }
 
 void laproque::FadingMultiDelay::add_delay( unsigned long n_samples_delay, float weight )
 {
     // Check if delay value works with buffer size
-    if ( n_samples_delay < _buffer_size && n_samples_delay > 0 )
+    if ( n_samples_delay < (unsigned long)_buffer_size && n_samples_delay > 0 && _n_delays < _max_n_delays )
     {
-        _delays[_n_delays].set_delay( n_samples_delay, weight );
-
-        if ( n_samples_delay < _min_delay ) _min_delay = n_samples_delay;
-        
+        _add_tap( _n_delays, n_samples_delay, weight );
         _n_delays++;
     }
 }
 
-void laproque::FadingMultiDelay::_update_min_delay()
+void laproque::FadingMultiDelay::set_delays( unsigned long* delays, float* weights, unsigned n_values )
 {
-    _min_delay = (unsigned long)_buffer_size;
-    unsigned long delay;
-    for ( unsigned dly = 0; dly < _n_delays; dly++ ) {
-        if ( _delays[dly].get_status() == DEAD) continue;
-        delay = _delays[dly].get_delay();
-        if ( delay < _min_delay ) _min_delay = delay;
+    _DelaySet& set = _sets[_back_set];
+    
+    set.n_delays = std::min( n_values, _max_n_delays );
+    for ( unsigned dly = 0; dly < set.n_delays; dly++) {
+        // Currently 0 delays are not possible
+        set.delays[dly] = std::max( delays[dly], 1lu );
+        set.weights[dly] = weights[dly];
     }
+    
+    _publish_set();
 }
 
-void laproque::FadingMultiDelay::set_delays( unsigned long* delays, float* weights, unsigned n_values )
+void laproque::FadingMultiDelay::set_weights( float* new_weights )
 {
-    if ( !_has_changed.load() )
-    {
-        for ( unsigned dly = 0; dly < std::min(n_values, N_DELAYS_MAX); dly++) {
-            // Currently 0 delays are not possible
-            _new_delays[dly] = std::max( delays[dly], 1lu );
-            _new_weights[dly] = weights[dly];
+    _DelaySet& set = _sets[_back_set];
+    
+    // Keep the delay values passed last.
+    if ( _has_published ) {
+        _DelaySet& last = _sets[_published_set];
+        set.n_delays = last.n_delays;
+        std::copy( last.delays.begin(), last.delays.begin() + last.n_delays, set.delays.begin() );
+    }
+    else {
+        set.n_delays = _n_delays;
+        for ( unsigned dly = 0; dly < _n_delays; dly++ ) {
+            set.delays[dly] = _delay_taps[dly] != NO_TAP ? _tap_delays[_delay_taps[dly]] : _buffer_size + 1;
         }
-        _new_n_delays = n_values;
-        _has_changed.store(true);
     }
+    
+    for ( unsigned dly = 0; dly < set.n_delays; dly++ ) {
+        set.weights[dly] = new_weights[dly];
+    }
+    
+    _publish_set();
+}
+
+void laproque::FadingMultiDelay::_publish_set()
+{
+    // A set which has not been applied yet comes back and gets overwritten next time.
+    _published_set = _back_set;
+    _back_set = _latest_set.exchange( _back_set | NEW_SET ) & ~NEW_SET;
+    _has_published = true;
 }
 
 void laproque::FadingMultiDelay::_update( )
 {
-    unsigned dly;
+    _DelaySet& set = _sets[_front_set];
+    unsigned dly, tap;
+    
+    _update_pending = false;
     
-    // Update
-    for ( dly = 0; dly < std::max(_new_n_delays, _n_delays); dly++ )
+    for ( dly = 0; dly < set.n_delays; dly++ )
     {
         // Check if delay value works with buffer size
-        if ( _new_delays[dly] <= (unsigned long)_buffer_size )
-        {
-            _delays[dly].set_delay( _new_delays[dly], _new_weights[dly] );
-            if ( _new_delays[dly] < _min_delay ) _min_delay = _new_delays[dly];
+        if ( set.delays[dly] > (unsigned long)_buffer_size ) continue;
+        
+        tap = _delay_taps[dly];
+        
+        // Unchanged delays keep playing without crossfade.
+        if ( tap != NO_TAP && _tap_delays[tap] == set.delays[dly] ) {
+            // Changed weights are ramped with the same reader.
+            if ( _tap_weights[tap] != set.weights[dly] ) _ramp_tap( tap, set.weights[dly] );
+            continue;
         }
+        
+        // Very fast successive updates can leave more than one dying tap per delay.
+        // Retry in the next process call when they are gone.
+        if ( _n_taps == _max_n_taps ) {
+            _update_pending = true;
+            continue;
+        }
+        
+        if ( tap != NO_TAP ) _kill_tap( tap );
+        _add_tap( dly, set.delays[dly], set.weights[dly] );
     }
     
     // Kill missing in arguments.
-    if ( _new_n_delays < _n_delays ) {
-        for ( dly = _new_n_delays; dly < _n_delays; dly++ ) {
-            if ( _delays[dly].get_status() != DEAD ) {
-                //printf("Killing %u\n", dly);
-                _delays[dly].set_status( DYING );
-            }
+    for ( dly = set.n_delays; dly < _n_delays; dly++ ) {
+        if ( _delay_taps[dly] != NO_TAP ) {
+            _kill_tap( _delay_taps[dly] );
+            _delay_taps[dly] = NO_TAP;
         }
     }
     
-    // Take maximum here, because dying delays have yet to be faded out.
-    _n_delays = std::max( _new_n_delays, _n_delays );
-    
-    // Note: Dont update minumum here because old delays could be shorter.
-}
-
-void laproque::FadingMultiDelay::set_weights( float* new_weights )
-{
-    for ( unsigned idx = 0; idx < _n_delays; idx++ )
-    {
-        _new_weights[idx] = new_weights[idx];
-        _has_changed.store( true );
-    }
+    _n_delays = set.n_delays;
 }
 
 void laproque::FadingMultiDelay::reset()
 {
-    // Set buffer values to 0
-    for ( ptrdiff_t idx = 0; idx < _buffer_size; idx++ )
-    {
-        _buffer[idx] = 0.f;
-        _core_buffer[idx] = 0.f;
-    }
-    _writer = _buffer;
+    _ring.reset();
 }
 
 void laproque::FadingMultiDelay::clear_delays()
 {
-    for ( unsigned dly = 0; dly < N_DELAYS_MAX; ++dly ) {
-        if ( _delays[dly].get_status() != DEAD ) _delays[dly].set_status( DYING );
+    for ( unsigned dly = 0; dly < _n_delays; ++dly ) {
+        if ( _delay_taps[dly] != NO_TAP ) _kill_tap( _delay_taps[dly] );
+        _delay_taps[dly] = NO_TAP;
     }
+    _n_delays = 0;
 }
 
 void laproque::FadingMultiDelay::print_buffer( unsigned n_frames )
 {
-    long part1 = _buffer_end - _writer;
-    if ( part1 > ptrdiff_t(n_frames) ) {
-        part1 = n_frames;
-    }
-    for ( long idx = 0; idx < part1; idx++) {
-        printf("%f\n", _writer[idx]);
+    // Oldest samples first.
+    unsigned long oldest = _ring.get_size() - 1;
+    for ( unsigned long idx = 0; idx < n_frames; idx++) {
+        printf("%f\n", _ring.get_sample( oldest - idx ));
     }
-    for ( long idx = 0; idx < ptrdiff_t(n_frames-part1); idx++) {
-        printf("%f\n", _buffer[idx]);
-    }
-}
-
-
-laproque::FadingMultiDelay::_DelayCore::_DelayCore( float* buf, float* buf_end, unsigned long n_delay, float** writer ) :
-_buf( buf ), _buf_end( buf_end ), _wtr( writer ), _buf_size( buf_end - buf )
-{
-    set_delay( n_delay, 1.f );
-    _status = BORN;
-}
-
-laproque::FadingMultiDelay::_DelayCore::_DelayCore() :
-_buf( nullptr ), _buf_end( nullptr ), _buf_size( 0 )
-{
-    _status = DEAD;
-}
-
-laproque::FadingMultiDelay::_DelayCore::_DelayCore( const _DelayCore &obj ) :
-_buf( obj._buf ), _buf_end( obj._buf_end ), _wtr( obj._wtr ), _buf_size( obj._buf_size )
-{
-    _rdr = obj._rdr;
-    _n_dly = obj._n_dly;
-    _status = obj._status;
-    _to_fade = obj._to_fade;
-    _old_rdr = obj._old_rdr;
-    _wgt = obj._wgt;
-    _old_wgt = obj._old_wgt;
-}
-
-laproque::FadingMultiDelay::_DelayCore &laproque::FadingMultiDelay::_DelayCore::operator= ( const laproque::FadingMultiDelay::_DelayCore &obj )
-{
-    this->_buf = obj._buf;
-    this->_buf_end = obj._buf_end;
-    this->_buf_size = obj._buf_size;
-    this->_wtr = obj._wtr;
-    this->_rdr = obj._rdr;
-    this->_old_rdr = obj._old_rdr;
-    this->_wgt = obj._wgt;
-    this->_old_wgt = obj._old_wgt;
-    
-    this->_n_dly = obj._n_dly;
-    this->_to_fade = obj._to_fade;
-    this->_status = obj._status;
-    
-    return *this;
 }
 
-void laproque::FadingMultiDelay::_DelayCore::set_delay( unsigned long delay, float weight )
+void laproque::FadingMultiDelay::_add_tap( unsigned dly, unsigned long delay, float weight )
 {
-    _old_wgt = _wgt;
-    _wgt = weight;
+    if ( _n_taps == _max_n_taps ) return;
     
-    _old_rdr = _rdr;
-    _rdr = *_wtr - delay;
-    if ( _rdr < _buf ) _rdr += _buf_size;
+    unsigned tap = _n_taps++;
     
-    _n_dly = delay;
-    _to_fade = N_FADE;
+    _tap_delays[tap] = delay;
+    _tap_weights[tap] = weight;
+    _tap_old_weights[tap] = 0.f;
+    _tap_to_fade[tap] = N_FADE;
+    _tap_status[tap] = BORN;
+    _tap_owners[tap] = dly;
     
-    if ( _status == DEAD ) _status = BORN;
-    else _status = CHANGE;
+    _delay_taps[dly] = tap;
 }
 
-
-void laproque::FadingMultiDelay::_DelayCore::set_status( laproque::FadingMultiDelay::FadeBehavior status )
+void laproque::FadingMultiDelay::_kill_tap( unsigned tap )
 {
-    _status = status;
-    _to_fade = N_FADE;
+    if ( _tap_status[tap] == DYING ) return;
+    
+    _tap_old_weights[tap] = _get_tap_gain( tap );
+    _tap_weights[tap] = 0.f;
+    _tap_to_fade[tap] = N_FADE;
+    _tap_status[tap] = DYING;
+    _tap_owners[tap] = NO_TAP;
 }
 
-unsigned long laproque::FadingMultiDelay::_DelayCore::get_delay()
+void laproque::FadingMultiDelay::_ramp_tap( unsigned tap, float weight )
 {
-    return _n_dly;
+    _tap_old_weights[tap] = _get_tap_gain( tap );
+    _tap_weights[tap] = weight;
+    _tap_to_fade[tap] = N_FADE;
+    _tap_status[tap] = CHANGE;
 }
 
-laproque::FadingMultiDelay::FadeBehavior laproque::FadingMultiDelay::_DelayCore::get_status()
+float laproque::FadingMultiDelay::_get_tap_gain( unsigned tap )
 {
-    return _status;
+    if ( _tap_to_fade[tap] == 0 ) return _tap_weights[tap];
+    
+    unsigned long pos = N_FADE - _tap_to_fade[tap];
+    return _tap_old_weights[tap] * fade_out[pos] + _tap_weights[tap] * fade_in[pos];
 }
 
-void laproque::FadingMultiDelay::_DelayCore::process( float* output, unsigned  long n_frames )
+void laproque::FadingMultiDelay::_remove_dead_taps()
 {
-    unsigned long idx;
-    unsigned long n_rem = n_frames;
-    
-    //printf("\tRequested: %lu\t", n_frames);
-    //printf("\tAvailable: %lu\t", _buf_end -  *_wtr);
-    
-    if ( _to_fade ) {
-        
-        float sample_old, sample_new;
-        unsigned long fade_now = std::min( _to_fade, n_frames );
-        unsigned long fade_start = N_FADE - _to_fade;
-        
-        switch (_status) {
-            case BORN:
-                //printf( "\tBORN. Fading: %lu at: %lu \n", fade_now, fade_start );
-                for ( idx = fade_start; idx < fade_start+fade_now; idx++ ) {
-                    sample_new = *_rdr * fade_in[idx] * _wgt;
-                    *output = sample_new;
-                    
-                    ++output;
-                    if ( ++_rdr == _buf_end) _rdr = _buf ;
-                }
-                break;
-                
-            case CHANGE:
-                //printf( "\tCHANGED. Fading: %lu at: %lu \n", fade_now, fade_start );
-                
-                for ( idx = fade_start; idx < fade_start+fade_now; idx++ ) {
-                    
-                    sample_old = *_old_rdr * fade_out[idx];
-                    sample_new = *_rdr * fade_in[idx];
-                    
-                    *output = sample_old*_old_wgt + sample_new*_wgt;
-                    
-                    ++output;
-                    if ( ++_rdr == _buf_end ) _rdr = _buf;
-                    if ( ++_old_rdr == _buf_end ) _old_rdr = _buf;
-                }
-                break;
-                
-            case DYING:
-                //printf( "\tDYING. Fading: %lu at: %lu \n", fade_now, fade_start );
-                for ( idx = fade_start; idx < fade_start+fade_now; idx++ ) {
-                    sample_old = *_rdr * fade_out[idx];
-                    *output = sample_old*_old_wgt;
-                    
-                    ++output;
-                    if ( ++_rdr == _buf_end) _rdr = _buf;
-                }
-                break;
-                
-            default:
-                break;
+    unsigned tap = 0;
+    while ( tap < _n_taps ) {
+        if ( _tap_status[tap] != DEAD ) {
+            tap++;
+            continue;
         }
         
-        _to_fade -= fade_now;
-        n_rem -= fade_now;
-        
-        if ( _to_fade == 0 ) {
-            if ( _status == BORN ) {
-                //printf("Hello...\n");
-                _status = ALIVE;
-            }
-            if ( _status == DYING ) {
-                _status = DEAD;
-                //printf("Goodbye...\n");
-            }
-            else _status = ALIVE;
-        }
-    }
-    
-    // The part from here on is only executed when fading is completed.
-    
-    // Death is mute.
-    if ( _status == DEAD) {
-        for ( idx = 0; idx < n_rem; idx++) {
-            output[idx] = 0.f;
-            ++_rdr;
-        }
-        n_rem = 0;
-    }
-    
-    unsigned long n_rdy;
-    
-    while ( n_rem ) {
-        
-        n_rdy = std::min( n_rem, (unsigned long)(_buf_end - _rdr) );
-        
-        for ( idx = 0; idx < n_rdy; idx++ ) {
-            output[idx] = _rdr[idx] * _wgt;
+        // Move last tap into the gap.
+        unsigned last = --_n_taps;
+        if ( tap != last ) {
+            _tap_delays[tap] = _tap_delays[last];
+            _tap_weights[tap] = _tap_weights[last];
+            _tap_old_weights[tap] = _tap_old_weights[last];
+            _tap_to_fade[tap] = _tap_to_fade[last];
+            _tap_status[tap] = _tap_status[last];
+            _tap_owners[tap] = _tap_owners[last];
+            
+            if ( _tap_owners[tap] != NO_TAP ) _delay_taps[_tap_owners[tap]] = tap;
         }
-        
-        _rdr += n_rdy;
-        if ( _rdr  == _buf_end ) _rdr = _buf;
-        
-        n_rem -= n_rdy;
-        
-        output += n_rdy;
     }
 }
 
@@ -11,6 +11,7 @@
 
 #include <math.h>
 #include <iostream>
+#include <algorithm>
 
 #include <pmmintrin.h>
 
@@ -82,6 +83,11 @@ void laproque::Filter::process( float* input, float* output, unsigned long long
 {
     _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
     
+    if ( _parallel_scan && n_frames > 1 ) {
+        _process_scan( input, output, n_frames );
+        return;
+    }
+    
     output[0] = input[0]*_b_coeffs[0] + _in_dlyline*_b_coeffs[1] - _out_dlyline*_a_coeffs[1];
 
     // No need to store delay line values internally in this part.
@@ -98,6 +104,226 @@ void laproque::Filter::process( float* input, float* output, unsigned long long
     _out_dlyline = output[n_frames-1];
 }
 
+/** @returns The vector shifted by lanes towards higher lanes, filled with zeros. */
+static inline __m128 shift_lanes( __m128 vector, int n_lanes )
+{
+    __m128i bits = _mm_castps_si128( vector );
+    bits = n_lanes == 1 ? _mm_slli_si128( bits, 4 ) : _mm_slli_si128( bits, 8 );
+    return _mm_castsi128_ps( bits );
+}
+
+/**
+ * @returns Four outputs of the recursion starting from zero, with the non-recursive part computed from
+ * input[0] to input[3] and input[-1] to input[2].
+ */
+static inline __m128 vector_scan( float* input, __m128 b0, __m128 b1, __m128 c1, __m128 c2 )
+{
+    __m128 u = _mm_add_ps( _mm_mul_ps( b0, _mm_loadu_ps( input ) ), _mm_mul_ps( b1, _mm_loadu_ps( input - 1 ) ) );
+    u = _mm_add_ps( u, _mm_mul_ps( c1, shift_lanes( u, 1 ) ) );
+    return _mm_add_ps( u, _mm_mul_ps( c2, shift_lanes( u, 2 ) ) );
+}
+
+void laproque::Filter::_process_scan( float* input, float* output, unsigned long long n_frames )
+{
+    float c = -_a_coeffs[1];
+    
+    // Powers of the feedback coefficient. carry[k] holds c^(4k+1) to c^(4k+4), the weights of the
+    // last output before 16 samples for the samples of vector k.
+    float power = 1.f;
+    float powers[16];
+    for ( unsigned idx = 0; idx < 16; idx++ ) {
+        power *= c;
+        powers[idx] = power;
+    }
+    __m128 c1 = _mm_set1_ps( c );
+    __m128 c2 = _mm_set1_ps( c * c );
+    __m128 carry[4];
+    for ( unsigned k = 0; k < 4; k++ ) {
+        carry[k] = _mm_loadu_ps( powers + 4*k );
+    }
+    __m128 b0 = _mm_set1_ps( _b_coeffs[0] );
+    __m128 b1 = _mm_set1_ps( _b_coeffs[1] );
+    
+    // The first sample needs the delay line, all later ones read the previous input from the block.
+    output[0] = input[0]*_b_coeffs[0] + _in_dlyline*_b_coeffs[1] - _out_dlyline*_a_coeffs[1];
+    
+    unsigned long long idx = 1;
+    __m128 last = _mm_set1_ps( output[0] );
+    
+    for ( ; idx + 16 <= n_frames; idx += 16 ) {
+        
+        // Prefix sums of the non-recursive part within each vector.
+        __m128 sum0 = vector_scan( input + idx, b0, b1, c1, c2 );
+        __m128 sum1 = vector_scan( input + idx + 4, b0, b1, c1, c2 );
+        __m128 sum2 = vector_scan( input + idx + 8, b0, b1, c1, c2 );
+        __m128 sum3 = vector_scan( input + idx + 12, b0, b1, c1, c2 );
+        
+        // Extend them over the 16 samples. Still independent of earlier outputs.
+        sum1 = _mm_add_ps( sum1, _mm_mul_ps( carry[0], _mm_shuffle_ps( sum0, sum0, 0xFF ) ) );
+        sum2 = _mm_add_ps( sum2, _mm_mul_ps( carry[0], _mm_shuffle_ps( sum1, sum1, 0xFF ) ) );
+        sum3 = _mm_add_ps( sum3, _mm_mul_ps( carry[0], _mm_shuffle_ps( sum2, sum2, 0xFF ) ) );
+        
+        // Only this step depends on the previous output.
+        _mm_storeu_ps( output + idx, _mm_add_ps( sum0, _mm_mul_ps( carry[0], last ) ) );
+        _mm_storeu_ps( output + idx + 4, _mm_add_ps( sum1, _mm_mul_ps( carry[1], last ) ) );
+        _mm_storeu_ps( output + idx + 8, _mm_add_ps( sum2, _mm_mul_ps( carry[2], last ) ) );
+        sum3 = _mm_add_ps( sum3, _mm_mul_ps( carry[3], last ) );
+        _mm_storeu_ps( output + idx + 12, sum3 );
+        
+        last = _mm_shuffle_ps( sum3, sum3, 0xFF );
+    }
+    
+    for ( ; idx < n_frames; idx++ ) {
+        output[idx] = input[idx]*_b_coeffs[0] + input[idx-1]*_b_coeffs[1] - output[idx-1]*_a_coeffs[1];
+    }
+    
+    _in_dlyline_backup = _in_dlyline;
+    _out_dlyline_backup = _out_dlyline;
+    
+    _in_dlyline = input[n_frames-1];
+    _out_dlyline = output[n_frames-1];
+}
+
+/** Samples whose coefficients are computed in one go. */
+static const unsigned GAIN_BLOCK = 64;
+
+/** Keeps the pole of the filter inside the unit circle. */
+static const float MIN_GAIN = 1e-6f;
+
+/**
+ * @returns The low pass gain tan(pi f) / (1 + tan(pi f)) = 0.5 + 0.5 tan(pi f - pi/4) for cutoff frequencies
+ * given as fractions of the sample rate. The tangent comes from its [5/4] Pade approximation, which is
+ * within 1e-8 of it on the whole range from -pi/4 to pi/4.
+ */
+static inline __m128 lowpass_gains( __m128 norm_freqs )
+{
+    norm_freqs = _mm_min_ps( _mm_max_ps( norm_freqs, _mm_setzero_ps() ), _mm_set1_ps( 0.5f ) );
+    __m128 y = _mm_sub_ps( _mm_mul_ps( norm_freqs, _mm_set1_ps( float(M_PI) ) ), _mm_set1_ps( float(M_PI/4) ) );
+    __m128 y2 = _mm_mul_ps( y, y );
+    
+    __m128 num = _mm_add_ps( _mm_set1_ps( -105.f ), y2 );
+    num = _mm_mul_ps( y, _mm_add_ps( _mm_set1_ps( 945.f ), _mm_mul_ps( y2, num ) ) );
+    __m128 den = _mm_add_ps( _mm_set1_ps( -420.f ), _mm_mul_ps( _mm_set1_ps( 15.f ), y2 ) );
+    den = _mm_add_ps( _mm_set1_ps( 945.f ), _mm_mul_ps( y2, den ) );
+    
+    __m128 half = _mm_set1_ps( 0.5f );
+    __m128 gains = _mm_add_ps( half, _mm_mul_ps( half, _mm_div_ps( num, den ) ) );
+    return _mm_min_ps( _mm_max_ps( gains, _mm_set1_ps( MIN_GAIN ) ), _mm_set1_ps( 1.f - MIN_GAIN ) );
+}
+
+void laproque::Filter::process_modulated( float* input, float* output, float* cutoff_freqs, unsigned long long n_frames )
+{
+    _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+    
+    if ( !n_frames ) {
+        return;
+    }
+    
+    float gains[GAIN_BLOCK];
+    __m128 inv_rate = _mm_set1_ps( 1.f / _sample_rate );
+    
+    _in_dlyline_backup = _in_dlyline;
+    _out_dlyline_backup = _out_dlyline;
+    
+    for ( unsigned long long done = 0; done < n_frames; done += GAIN_BLOCK ) {
+        unsigned n_ready = unsigned( std::min( n_frames - done, (unsigned long long)(GAIN_BLOCK) ) );
+        
+        for ( unsigned idx = 0; idx < n_ready; idx += 4 ) {
+            __m128 freqs;
+            if ( idx + 4 <= n_ready ) {
+                freqs = _mm_loadu_ps( cutoff_freqs + done + idx );
+            }
+            else {
+                float rest[4] = { 0.f, 0.f, 0.f, 0.f };
+                std::copy( cutoff_freqs + done + idx, cutoff_freqs + done + n_ready, rest );
+                freqs = _mm_loadu_ps( rest );
+            }
+            _mm_storeu_ps( gains + idx, lowpass_gains( _mm_mul_ps( freqs, inv_rate ) ) );
+        }
+        
+        _process_gains( input + done, output + done, gains, n_ready );
+    }
+    
+    _cutoff_freq = std::min( std::max( cutoff_freqs[n_frames-1], 0.f ), 0.5f * _sample_rate );
+    _set_gain( gains[(n_frames-1) % GAIN_BLOCK] );
+}
+
+void laproque::Filter::process_sweep( float* input, float* output, float end_freq, unsigned long long n_frames )
+{
+    _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+    
+    if ( !n_frames ) {
+        return;
+    }
+    
+    float gains[GAIN_BLOCK];
+    float start_gain = 0.5f * ( _a_coeffs[1] + 1.f );
+    float end_gain = _mm_cvtss_f32( lowpass_gains( _mm_set1_ps( end_freq / _sample_rate ) ) );
+    float step = ( end_gain - start_gain ) / float( n_frames );
+    
+    _in_dlyline_backup = _in_dlyline;
+    _out_dlyline_backup = _out_dlyline;
+    
+    for ( unsigned long long done = 0; done < n_frames; done += GAIN_BLOCK ) {
+        unsigned n_ready = unsigned( std::min( n_frames - done, (unsigned long long)(GAIN_BLOCK) ) );
+        
+        for ( unsigned idx = 0; idx < n_ready; idx++ ) {
+            gains[idx] = start_gain + step * float( done + idx + 1 );
+        }
+        
+        _process_gains( input + done, output + done, gains, n_ready );
+    }
+    
+    _cutoff_freq = std::min( std::max( end_freq, 0.f ), 0.5f * _sample_rate );
+    _set_gain( end_gain );
+}
+
+void laproque::Filter::_process_gains( float* input, float* output, float* gains, unsigned long long n_frames )
+{
+    float in_last = _in_dlyline;
+    float out_last = _out_dlyline;
+    
+    // y[n] = k (x[n] + x[n-1]) + (1-2k) y[n-1] for the low pass, (1-k) (x[n] - x[n-1]) + (1-2k) y[n-1] for the high pass.
+    if ( _f_type == LOW ) {
+        for ( unsigned long long idx = 0; idx < n_frames; idx++ ) {
+            float gain = gains[idx];
+            out_last = gain * ( input[idx] + in_last ) + ( 1.f - 2.f*gain ) * out_last;
+            in_last = input[idx];
+            output[idx] = out_last;
+        }
+    }
+    else {
+        for ( unsigned long long idx = 0; idx < n_frames; idx++ ) {
+            float gain = gains[idx];
+            out_last = ( 1.f - gain ) * ( input[idx] - in_last ) + ( 1.f - 2.f*gain ) * out_last;
+            in_last = input[idx];
+            output[idx] = out_last;
+        }
+    }
+    
+    _in_dlyline = in_last;
+    _out_dlyline = out_last;
+}
+
+void laproque::Filter::_set_gain( float gain )
+{
+    _b_coeffs[0] = gain;
+    _b_coeffs[1] = gain;
+    
+    _a_coeffs[0] = 1;
+    _a_coeffs[1] = 2.f * gain - 1.f;
+    
+    if (_f_type == HIGH) {
+        _b_coeffs[0] = 1 - _b_coeffs[0];
+        _b_coeffs[1] = - _b_coeffs[0];
+    }
+}
+
+void laproque::Filter::set_parallel_scan( bool enabled )
+{
+    _parallel_scan = enabled;
+}
+
 void laproque::Filter::set_cutoff_freq( float co_freq )
 {
     _cutoff_freq = co_freq;
@@ -115,3 +341,11 @@ void laproque::Filter::reverse()
     _in_dlyline = _in_dlyline_backup;
     _out_dlyline = _out_dlyline_backup;
 }
+
+void laproque::Filter::get_coeffs( float* b_coeffs, float* a_coeffs )
+{
+    b_coeffs[0] = _b_coeffs[0];
+    b_coeffs[1] = _b_coeffs[1];
+    a_coeffs[0] = _a_coeffs[0];
+    a_coeffs[1] = _a_coeffs[1];
+}
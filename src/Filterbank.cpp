@@ -9,6 +9,7 @@
 #include "Filterbank.hpp"
 #include <math.h>
 #include <cstring>
+#include <algorithm>
 
 laproque::Filterbank::Filterbank(
                        std::vector<float> co_freqs
@@ -112,6 +113,59 @@ void laproque::Filterbank::process( float *input, float **output, unsigned long
     }
 }
 
+void laproque::Filterbank::process_sweep( float *input, float **output, const std::vector<float>& end_freqs, unsigned long n_frames )
+{
+    if ( end_freqs.size() != _crossover_freqs.size() ) {
+        return;
+    }
+    
+    std::copy( _crossover_freqs.begin(), _crossover_freqs.end(), _start_freqs.begin() );
+    unsigned long n_done = 0;
+    unsigned band;
+    float part, freq;
+    
+    while ( n_done < n_frames ) {
+        // Update number of processable frames;
+        n_frames - n_done < _intern_buff_size ? _n_ready = n_frames - n_done : _n_ready = _intern_buff_size;
+        n_done += _n_ready;
+        part = float(n_done) / float(n_frames);
+        
+        memcpy( _low_band, input, _n_ready * sizeof(float) );
+        
+        // Process filters, each moving to its frequency at the end of this piece.
+        for ( band = _n_bands; --band; ) {
+            freq = _start_freqs[band-1] + part * ( end_freqs[band-1] - _start_freqs[band-1] );
+            
+            // High Pass
+            _filters[band*2-1].process_sweep( _low_band, output[band], freq, _n_ready );
+            
+            // Low Pass
+            if ( _low_band == _buffer1 ) {
+                _filters[band*2-2].process_sweep( _low_band, _buffer2, freq, _n_ready );
+                _low_band = _buffer2;
+            }
+            else {
+                _filters[band*2-2].process_sweep( _low_band, _buffer1, freq, _n_ready );
+                _low_band = _buffer1;
+            }
+        }
+        
+        memcpy( output[0], _low_band, _n_ready*sizeof(float) );
+        
+        // Increment buffers.
+        input += _n_ready;
+        for ( band = 0; band < _n_bands; band++ ) {
+            output[band] += _n_ready;
+        }
+    }
+    // Reset band buffer pointer
+    for ( band = 0; band < _n_bands; band++ ) {
+        output[band] -= n_frames;
+    }
+    
+    std::copy( end_freqs.begin(), end_freqs.end(), _crossover_freqs.begin() );
+}
+
 void laproque::Filterbank::reverse()
 {
     for ( unsigned idx = 0; idx < _n_filters; idx++ ) {
@@ -122,6 +176,7 @@ void laproque::Filterbank::reverse()
 void laproque::Filterbank::renew( std::vector<float> new_co_freqs )
 {
     _crossover_freqs = new_co_freqs;
+    _start_freqs.resize( _crossover_freqs.size() );
     
     _n_bands = unsigned(_crossover_freqs.size()) + 1;
     _n_filters = (_n_bands-1) * 2;
@@ -12,9 +12,15 @@ laproque::FilteredDelay::FilteredDelay( unsigned n_delay
                               , unsigned max_delay
                               , std::vector<float> co_freqs
                               , unsigned sample_rate
+                              , bool collapsed
                               )
 : Delay( n_delay, max_delay )
 {
+    _collapsed = collapsed;
+    _co_freqs = co_freqs;
+    _sample_rate = sample_rate;
+    
+
     _filterbank.renew( co_freqs );
     
     _n_bands = unsigned(co_freqs.size()) + 1;
@@ -30,6 +36,9 @@ laproque::FilteredDelay::FilteredDelay( unsigned n_delay
     
     _delay_buffer = new float[_intern_buff_size];
     
+    _section_states.resize( _n_bands );
+    _update_sections();
+    
     // Set weights to one
     reset_weights();
 }
@@ -49,6 +58,11 @@ float laproque::FilteredDelay::operator()( float input )
     float output;
     Delay::process( &input, &output, 1 );
     
+    if ( _collapsed ) {
+        _process_collapsed( &output, &output, 1 );
+        return output;
+    }
+    
     _filterbank( output, _band_buffer[0] );
     
     output = 0.f;
@@ -70,6 +84,14 @@ void laproque::FilteredDelay::process( float *input, float *output, unsigned lon
         // Process input in delay.
         Delay::process( input, _delay_buffer, _n_ready );
         
+        if ( _collapsed ) {
+            _process_collapsed( _delay_buffer, output, _n_ready );
+            input += _n_ready;
+            output += _n_ready;
+            _n_remaining -= _n_ready;
+            continue;
+        }
+        
         // Process input in filterbank.
         _filterbank.process( _delay_buffer, _band_buffer, _n_ready );
         
@@ -89,23 +111,82 @@ void laproque::FilteredDelay::process( float *input, float *output, unsigned lon
     }
 }
 
+void laproque::FilteredDelay::_process_collapsed( float* input, float* output, unsigned long n_frames )
+{
+    unsigned n_sections = _n_bands - 1;
+    float* states = &_section_states[0];
+    
+    for ( unsigned long idx = 0; idx < n_frames; idx++ ) {
+        float section_input = input[idx];
+        float result = _direct_gain * section_input;
+        
+        // The output of every low pass is the input of the next one.
+        for ( unsigned section = 0; section < n_sections; section++ ) {
+            float section_output = _section_b[section] * (section_input + states[section]) - _section_a[section] * states[section+1];
+            states[section] = section_input;
+            section_input = section_output;
+            result += _section_gains[section] * section_output;
+        }
+        states[n_sections] = section_input;
+        
+        output[idx] = result;
+    }
+}
+
+void laproque::FilteredDelay::_update_sections()
+{
+    unsigned n_sections = _n_bands - 1;
+    _section_b.resize( n_sections );
+    _section_a.resize( n_sections );
+    
+    // The Filterbank splits off the highest band first.
+    for ( unsigned section = 0; section < n_sections; section++ ) {
+        float b_coeffs[2], a_coeffs[2];
+        Filter low_pass( LOW, _co_freqs[n_sections - 1 - section], _sample_rate );
+        low_pass.get_coeffs( b_coeffs, a_coeffs );
+        _section_b[section] = b_coeffs[0];
+        _section_a[section] = a_coeffs[1];
+    }
+}
+
+void laproque::FilteredDelay::_update_gains()
+{
+    unsigned n_sections = _n_bands - 1;
+    _section_gains.resize( n_sections );
+    
+    // The low pass of crossover k leaves the sum of bands 0 to k, so each section
+    // is weighted with the difference of two neighbouring band weights.
+    _direct_gain = _band_weights[n_sections];
+    for ( unsigned section = 0; section < n_sections; section++ ) {
+        unsigned band = n_sections - 1 - section;
+        _section_gains[section] = _band_weights[band] - _band_weights[band+1];
+    }
+}
+
 void laproque::FilteredDelay::reset_weights()
 {
     _band_weights.resize( _n_bands );
     for ( unsigned band = 0; band < _n_bands; band++ ) {
         _band_weights[band] = 1.f;
     }
+    _update_gains();
 }
 
 void laproque::FilteredDelay::set_co_freqs( std::vector<float> new_co_freqs )
 {
     _filterbank.set_co_freqs( new_co_freqs );
+    
+    if ( new_co_freqs.size() == _co_freqs.size() ) {
+        _co_freqs = new_co_freqs;
+        _update_sections();
+    }
 }
 
 void laproque::FilteredDelay::set_all_weights( std::vector<float> new_band_weights )
 {
     if ( _band_weights.size() == new_band_weights.size() ) {
         _band_weights = new_band_weights;
+        _update_gains();
     }
 }
 
@@ -113,6 +194,7 @@ void laproque::FilteredDelay::set_band_weight( float weight, unsigned int band_i
 {
     if ( band_idx < _band_weights.size() ) {
         _band_weights[band_idx] = weight;
+        _update_gains();
     }
 }
 
@@ -7,13 +7,24 @@
 //
 
 #include "FilteredMultiDelay.hpp"
+#include <algorithm>
 
-laproque::FilteredMultiDelay::FilteredMultiDelay( unsigned n_bands, unsigned sample_rate, unsigned block_size, unsigned max_delay )
-: MultiDelay( max_delay )
+laproque::FilteredMultiDelay::FilteredMultiDelay( unsigned n_bands, unsigned sample_rate, unsigned block_size, unsigned max_delay, bool band_domain )
+// The input history is not needed in band domain mode.
+: MultiDelay( band_domain ? 1 : max_delay, block_size )
 , _filterbank( freqs, sample_rate )
 {
     _block_size = block_size;
     _n_bands = n_bands;
+    _band_domain = band_domain;
+    _buffer_size = max_delay;
+    
+    if ( _band_domain ) {
+        for ( unsigned band = 0; band < _n_bands; band++ ) {
+            _band_rings.push_back( new RingBuffer( max_delay, block_size ) );
+        }
+        _tap_gains.resize( _n_bands );
+    }
     
     _band_weights = new float[n_bands];
     _internal_buffer = new float[block_size];
@@ -33,10 +44,19 @@ laproque::FilteredMultiDelay::~FilteredMultiDelay()
     delete [] _band_buffer;
     delete [] _internal_buffer;
     delete [] _band_weights;
+    
+    for ( unsigned band = 0; band < _band_rings.size(); band++ ) {
+        delete _band_rings[band];
+    }
 }
 
 void laproque::FilteredMultiDelay::process( float* input, float* output, unsigned long n_frames )
 {
+    if ( _band_domain ) {
+        _process_bands( input, output, n_frames );
+        return;
+    }
+    
     unsigned idx, band;
 
     _filterbank.process( input, _band_buffer, n_frames );
@@ -53,6 +73,79 @@ void laproque::FilteredMultiDelay::process( float* input, float* output, unsigne
     MultiDelay::process( _internal_buffer, output, n_frames );
 }
 
+void laproque::FilteredMultiDelay::_process_bands( float* input, float* output, unsigned long n_frames )
+{
+    unsigned long idx, n_ready;
+    unsigned band;
+    
+    while ( n_frames ) {
+        n_ready = std::min( n_frames, (unsigned long)(_block_size) );
+        
+        // Filter once and store the bands.
+        _filterbank.process( input, _band_buffer, n_ready );
+        for ( band = 0; band < _n_bands; band++ ) {
+            _band_rings[band]->write( _band_buffer[band], n_ready );
+        }
+        
+        for ( idx = 0; idx < n_ready; idx++ ) {
+            output[idx] = 0.f;
+        }
+        
+        for ( unsigned dly = 0; dly < _n_delays; dly++ ) {
+            float* tap_band_weights = &_tap_band_weights[dly * _n_bands];
+            for ( band = 0; band < _n_bands; band++ ) {
+                _tap_gains[band] = _weights[dly] * _band_weights[band] * tap_band_weights[band];
+            }
+            
+            for ( band = 0; band < _n_bands; band++ ) {
+                const float* delayed = _band_rings[band]->get_block( (unsigned long)(_n_samples_delay[dly]), n_ready );
+                float gain = _tap_gains[band];
+                
+                for ( idx = 0; idx < n_ready; idx++ ) {
+                    output[idx] += delayed[idx] * gain;
+                }
+            }
+        }
+        
+        input += n_ready;
+        output += n_ready;
+        n_frames -= n_ready;
+    }
+}
+
+void laproque::FilteredMultiDelay::add_delay( long delay, float weight )
+{
+    unsigned n_delays = _n_delays;
+    MultiDelay::add_delay( delay, weight );
+    
+    if ( _n_delays > n_delays ) {
+        _tap_band_weights.resize( _n_delays * _n_bands, 1.f );
+    }
+}
+
+void laproque::FilteredMultiDelay::clear_delays()
+{
+    MultiDelay::clear_delays();
+    _tap_band_weights.clear();
+}
+
+void laproque::FilteredMultiDelay::reset()
+{
+    MultiDelay::reset();
+    for ( unsigned band = 0; band < _band_rings.size(); band++ ) {
+        _band_rings[band]->reset();
+    }
+}
+
+void laproque::FilteredMultiDelay::set_tap_band_weights( unsigned delay_idx, float* new_band_weights )
+{
+    if ( delay_idx < _n_delays ) {
+        for ( unsigned band = 0; band < _n_bands; band++ ) {
+            _tap_band_weights[delay_idx * _n_bands + band] = new_band_weights[band];
+        }
+    }
+}
+
 unsigned laproque::FilteredMultiDelay::get_n_bands()
 {
     return _n_bands;
@@ -84,6 +177,18 @@ void laproque::FilteredMultiDelay::set_co_freqs( std::vector<float> co_freqs )
 
 void laproque::FilteredMultiDelay::replace_buffer( float* sample_data, unsigned long n_frames )
 {
+    if ( _band_domain ) {
+        if ( n_frames > _block_size ) return;
+        
+        // Split the replacement again with the filter states before the last block.
+        _filterbank.reverse();
+        _filterbank.process( sample_data, _band_buffer, n_frames );
+        for ( unsigned band = 0; band < _n_bands; band++ ) {
+            _band_rings[band]->replace( _band_buffer[band], n_frames );
+        }
+        return;
+    }
+    
     MultiDelay::replace_buffer( sample_data, n_frames );
     _filterbank.reverse();
 }
@@ -0,0 +1,236 @@
+//
+//  HybridMultiDelay.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "HybridMultiDelay.hpp"
+#include <algorithm>
+#include <cstring>
+#include <math.h>
+
+laproque::HybridMultiDelay::HybridMultiDelay( unsigned block_size, unsigned max_delay ) :
+MultiDelay( max_delay, block_size )
+{
+    _block_size = block_size;
+    _conv_input.resize( _block_size );
+    _conv_output.resize( _block_size );
+    
+    // The dense span is never longer than the buffer.
+    unsigned max_n_parts = max_delay / _block_size + 1;
+    _state_input.resize( _block_size );
+    _state_spectra = fftwf_alloc_complex( max_n_parts * (_block_size + 1) );
+    _history.resize( max_n_parts * _block_size );
+}
+
+laproque::HybridMultiDelay::~HybridMultiDelay()
+{
+    for ( unsigned split = 0; split < 3; split++ ) {
+        delete _splits[split].convolver;
+    }
+    fftwf_free( _state_spectra );
+}
+
+void laproque::HybridMultiDelay::process( float* input, float* output, unsigned long n_frames )
+{
+    unsigned long idx;
+    
+    if ( _latest_split.load() & NEW_SPLIT ) {
+        _update();
+    }
+    
+    _Split& split = _splits[_front_split];
+    
+    for ( unsigned long block = 0; block < n_frames / _block_size; block++ ) {
+        
+        _ring.write( input, _block_size );
+        
+        for ( idx = 0; idx < _block_size; idx++ ) {
+            output[idx] = 0.f;
+        }
+        
+        // Delays outside the dense span.
+        for ( unsigned sparse = 0; sparse < split.sparse_delays.size(); sparse++ ) {
+            const float* delayed = _ring.get_block( split.sparse_delays[sparse], _block_size );
+            float weight = split.sparse_weights[sparse];
+            
+            for ( idx = 0; idx < _block_size; idx++ ) {
+                output[idx] += delayed[idx] * weight;
+            }
+        }
+        
+        // Dense span.
+        if ( split.convolver ) {
+            memcpy( &_conv_input[0], _ring.get_block( (unsigned long)(split.dense_offset), _block_size ), _block_size*sizeof(float) );
+            split.convolver->process( &_conv_input[0], &_conv_output[0] );
+            
+            for ( idx = 0; idx < _block_size; idx++ ) {
+                output[idx] += _conv_output[idx];
+            }
+        }
+        
+        input += _block_size;
+        output += _block_size;
+    }
+}
+
+void laproque::HybridMultiDelay::_update()
+{
+    // The front split goes back to the control thread with the exchange, so its state is saved first.
+    _Split& old_split = _splits[_front_split];
+    Convolver* old_convolver = old_split.convolver;
+    long old_offset = old_split.dense_offset;
+    unsigned old_n_parts = old_convolver ? old_convolver->get_n_parts() : 0;
+    if ( old_convolver ) {
+        old_convolver->get_input_state( _state_spectra, &_state_input[0] );
+    }
+    
+    _front_split = _latest_split.exchange( _front_split ) & ~NEW_SPLIT;
+    
+    Convolver* convolver = _splits[_front_split].convolver;
+    long dense_offset = _splits[_front_split].dense_offset;
+    if ( !convolver ) return;
+    
+    unsigned n_parts = convolver->get_n_parts();
+    
+    // Same input as before, e.g. after a weight change.
+    if ( old_convolver && old_offset == dense_offset && old_n_parts == n_parts ) {
+        convolver->set_input_state( _state_spectra, &_state_input[0] );
+        return;
+    }
+    
+    // Continue with the signal history the delays would have read.
+    for ( unsigned part = 0; part < n_parts; part++ ) {
+        unsigned long delay = (unsigned long)(dense_offset) + (n_parts-1-part) * _block_size;
+        memcpy( &_history[part * _block_size], _ring.get_block( delay, _block_size ), _block_size*sizeof(float) );
+    }
+    convolver->set_input_history( &_history[0] );
+}
+
+void laproque::HybridMultiDelay::commit()
+{
+    _split();
+}
+
+void laproque::HybridMultiDelay::set_delays( long* new_delays )
+{
+    MultiDelay::set_delays( new_delays );
+    _split();
+}
+
+void laproque::HybridMultiDelay::set_weights( float* new_weights )
+{
+    MultiDelay::set_weights( new_weights );
+    _publish();
+}
+
+void laproque::HybridMultiDelay::clear_delays()
+{
+    MultiDelay::clear_delays();
+    _split();
+}
+
+unsigned laproque::HybridMultiDelay::get_n_dense()
+{
+    return _n_dense;
+}
+
+float laproque::HybridMultiDelay::get_direct_cost()
+{
+    return _direct_cost;
+}
+
+float laproque::HybridMultiDelay::get_hybrid_cost()
+{
+    return _hybrid_cost;
+}
+
+float laproque::HybridMultiDelay::_conv_cost( long n_samples )
+{
+    float fft_size = 2.f * _block_size;
+    float n_parts = ceilf( float(n_samples) / float(_block_size) );
+    
+    // Forward and inverse FFT plus complex multiply-add and shift of every partition.
+    return 2.f * fft_size * log2f( fft_size ) + n_parts * (_block_size + 1) * 5.f;
+}
+
+void laproque::HybridMultiDelay::_split()
+{
+    // Sort delay indices by delay value.
+    _order.resize( _n_delays );
+    for ( unsigned dly = 0; dly < _n_delays; dly++ ) {
+        _order[dly] = dly;
+    }
+    std::sort( _order.begin(), _order.end(), [this]( unsigned a, unsigned b ) {
+        return _n_samples_delay[a] < _n_samples_delay[b];
+    } );
+    
+    // Find the span of delays which saves most when convolved instead of read directly.
+    _direct_cost = float(_n_delays) * _block_size;
+    float best_saving = 0.f;
+    unsigned first = 0, last = 0;
+    
+    for ( unsigned start = 0; start < _n_delays; start++ ) {
+        for ( unsigned end = start; end < _n_delays; end++ ) {
+            long span = _n_samples_delay[_order[end]] - _n_samples_delay[_order[start]] + 1;
+            float saving = float(end - start + 1) * _block_size - _conv_cost( span );
+            
+            if ( saving > best_saving ) {
+                best_saving = saving;
+                first = start;
+                last = end + 1;
+            }
+        }
+    }
+    
+    _hybrid_cost = _direct_cost - best_saving;
+    _n_dense = last - first;
+    _first_dense = first;
+    _last_dense = last;
+    
+    _publish();
+}
+
+void laproque::HybridMultiDelay::_publish()
+{
+    _Split& split = _splits[_back_split];
+    
+    split.sparse_delays.clear();
+    split.sparse_weights.clear();
+    for ( unsigned idx = 0; idx < _order.size(); idx++ ) {
+        if ( idx < _first_dense || idx >= _last_dense ) {
+            split.sparse_delays.push_back( (unsigned long)(_n_samples_delay[_order[idx]]) );
+            split.sparse_weights.push_back( _weights[_order[idx]] );
+        }
+    }
+    
+    if ( _n_dense == 0 ) {
+        delete split.convolver;
+        split.convolver = nullptr;
+    }
+    else {
+        // Equivalent impulse response of the dense span.
+        split.dense_offset = _n_samples_delay[_order[_first_dense]];
+        long span = _n_samples_delay[_order[_last_dense-1]] - split.dense_offset + 1;
+        std::vector< float > imp_resp( (unsigned long)(span), 0.f );
+        
+        for ( unsigned idx = _first_dense; idx < _last_dense; idx++ ) {
+            imp_resp[(unsigned long)(_n_samples_delay[_order[idx]] - split.dense_offset)] += _weights[_order[idx]];
+        }
+        
+        // The Convolver of this split is not used by process(), so it can be reused if the length fits.
+        unsigned n_parts = unsigned( (span + _block_size - 1) / _block_size );
+        if ( split.convolver && split.convolver->get_n_parts() == n_parts ) {
+            split.convolver->set_imp_response( &imp_resp[0], (unsigned long)(span) );
+        }
+        else {
+            delete split.convolver;
+            split.convolver = new Convolver( &imp_resp[0], (unsigned long)(span), _block_size, FFTW_ESTIMATE );
+        }
+    }
+    
+    // A split which has not been applied yet comes back and gets overwritten next time.
+    _back_split = _latest_split.exchange( _back_split | NEW_SPLIT ) & ~NEW_SPLIT;
+}
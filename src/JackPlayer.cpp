@@ -7,22 +7,34 @@
 //
 
 #include "JackPlayer.hpp"
+#include "Resampler.hpp"
 
 #include <math.h>
 #include <sndfile.h>
 #include <dirent.h>
 #include <algorithm>
 #include <cstring>
+#include <climits>
+#include <chrono>
 
-laproque::JackPlayer::JackPlayer() :
+laproque::JackPlayer::JackPlayer( bool streaming, unsigned long prefetch_size ) :
 JackPlugin("Player", 0, 1), _gen(std::random_device{}())
 {
     _setup_fades();
+    
+    _streaming = streaming;
+    if ( _streaming ) {
+        _fifo = new SampleFifo( std::max( prefetch_size, 4 * _stream_chunk ) );
+        _reader = std::thread( &JackPlayer::_stream_audio, this );
+    }
 }
 
 unsigned laproque::JackPlayer::add_file( std::string file_path )
 {
+    while ( _playlist_lock.test_and_set( std::memory_order_acquire ) );
     _playlist.push_back( file_path );
+    _playlist_lock.clear( std::memory_order_release );
+    
     _read_audio( file_path );
     return unsigned(_playlist.size() - 1);
 }
@@ -58,8 +70,13 @@ void laproque::JackPlayer::select_by_idx( unsigned int idx )
     {
         if (_playing.load() ) stop();
         _current_idx.store( idx );
-        _player_position = &_audio_buffers[_current_idx.load()][0];
-        _n_ready = _audio_buffers[_current_idx.load()].size();
+        if ( _streaming ) {
+            _request_track( idx );
+        }
+        else {
+            _player_position = &_audio_buffers[_current_idx.load()][0];
+            _n_ready = _audio_buffers[_current_idx.load()].size();
+        }
         printf("Playing: %s\n", _playlist[_current_idx.load()].c_str());
     }
 }
@@ -87,7 +104,8 @@ void laproque::JackPlayer::shuffle_unique()
 
 void laproque::JackPlayer::play()
 {
-    if ( _n_ready == 0 && _playlist.size()>0 ) {
+    bool ended = _streaming ? _stream_ended() : _n_ready == 0;
+    if ( ended && _playlist.size()>0 ) {
         select_by_idx(0);
     }
     
@@ -106,8 +124,13 @@ void laproque::JackPlayer::stop()
     if ( _playing.load() ) _stopped.store( true );
     _playing.store( false );
     
-    _player_position = &_audio_buffers[_current_idx.load()][0];
-    _n_ready = _audio_buffers[_current_idx.load()].size();
+    if ( _streaming ) {
+        _request_track( _current_idx.load() );
+    }
+    else {
+        _player_position = &_audio_buffers[_current_idx.load()][0];
+        _n_ready = _audio_buffers[_current_idx.load()].size();
+    }
 }
 
 void laproque::JackPlayer::start( std::string file_path )
@@ -170,26 +193,34 @@ void laproque::JackPlayer::render_audio(  jack_nframes_t n_frames
     }
     else
     {
-        sf_count_t playable = n_frames > _n_ready ? _n_ready : n_frames;
-        // Handle fade in.
-        if ( _started ) {
+        sf_count_t playable;
+        
+        // Copy data to output buffer;
+        if ( _streaming ) {
+            playable = _read_stream( out_buffers[0], n_frames );
+        }
+        else {
+            playable = n_frames > _n_ready ? _n_ready : n_frames;
+            std::memcpy( out_buffers[0], _player_position, playable*sizeof(float) );
+            
+            _player_position += playable;
+            _n_ready -= playable;
+        }
+        
+        // Handle fade in. A stream may not have delivered the first samples yet.
+        if ( _started && playable ) {
             for ( unsigned idx = 0; idx < playable; idx++ ) {
-                out_buffers[0][idx] = _player_position[idx] * _fadein[idx];
+                out_buffers[0][idx] *= _fadein[idx];
             }
             _started.store( false );
         }
         // Handle fade out.
         else if ( _stopped ) {
             for ( unsigned idx = 0; idx < playable; idx++ ) {
-                out_buffers[0][idx] = _player_position[idx] * _fadeout[idx];
+                out_buffers[0][idx] *= _fadeout[idx];
             }
             _stopped.store( false );
         }
-        // Copy data to output buffer;
-        else {
-            std::memcpy( out_buffers[0], _player_position, playable*sizeof(float) );
-        }
-        
         
         // Write zeros if data to short for block.
         if ( playable < n_frames ) {
@@ -198,10 +229,7 @@ void laproque::JackPlayer::render_audio(  jack_nframes_t n_frames
             }
         }
         
-        _player_position += playable;
-        _n_ready -= playable;
-        
-        if ( _n_ready == 0)
+        if ( _streaming ? _stream_ended() : _n_ready == 0 )
         {
             if ( _loop.load() ) {
                 stop();
@@ -220,7 +248,17 @@ void laproque::JackPlayer::render_audio(  jack_nframes_t n_frames
 
 void laproque::JackPlayer::_read_audio( std::string file_path )
 {
-    if ( !_playing ) {
+    // A streamed file is only checked here. The reader thread decodes it during playback.
+    if ( _streaming ) {
+        SF_INFO audio_info;
+        SNDFILE* audio_file = sf_open( file_path.c_str(), SFM_READ, &audio_info );
+        if (audio_file)
+        {
+            _n_tracks++;
+            sf_close( audio_file );
+        }
+    }
+    else if ( !_playing ) {
         SF_INFO audio_info;
         SNDFILE* audio_file = sf_open( file_path.c_str(), SFM_READ, &audio_info );
         if (audio_file)
@@ -230,6 +268,14 @@ void laproque::JackPlayer::_read_audio( std::string file_path )
             
             sf_read_float( audio_file, &_audio_buffers[_n_tracks][0], audio_info.frames );
             
+            // Convert to the rate of the Jack server.
+            if ( audio_info.samplerate != int(_sample_rate) && audio_info.frames > 0 ) {
+                Resampler resampler( audio_info.samplerate, _sample_rate );
+                std::vector<float> converted;
+                resampler.convert( &_audio_buffers[_n_tracks][0], (unsigned long)(audio_info.frames), converted );
+                _audio_buffers[_n_tracks].swap( converted );
+            }
+            
             _n_tracks++;
         }
         sf_close( audio_file );
@@ -258,7 +304,17 @@ bool laproque::JackPlayer::get_shuffle()
 
 unsigned laproque::JackPlayer::get_n_tracks()
 {
-    return _audio_buffers.size();
+    return _n_tracks;
+}
+
+bool laproque::JackPlayer::get_streaming()
+{
+    return _streaming;
+}
+
+unsigned long laproque::JackPlayer::get_n_underruns()
+{
+    return _n_underruns.load();
 }
 
 void laproque::JackPlayer::set_autoplay( bool value )
@@ -279,11 +335,22 @@ void laproque::JackPlayer::set_shuffle( bool value )
 laproque::JackPlayer::~JackPlayer()
 {
     deactivate();
+    
+    if ( _streaming ) {
+        _quit.store( true );
+        _reader.join();
+        delete _fifo;
+    }
 }
 
 void laproque::JackPlayer::print_status()
 {
-    printf("Current Track: %i %lu %s\n", _current_idx.load(), _audio_buffers[_current_idx].size(), _playlist[_current_idx].c_str() );
+    if ( _streaming ) {
+        printf("Current Track: %i %s\n", _current_idx.load(), _playlist[_current_idx].c_str() );
+    }
+    else {
+        printf("Current Track: %i %lu %s\n", _current_idx.load(), _audio_buffers[_current_idx].size(), _playlist[_current_idx].c_str() );
+    }
     printf( "----- Playlist: %i Tracks -----\n", _n_tracks  );
     for ( unsigned trk = 0; trk < _n_tracks; trk++ ) {
         printf( "\t%s\n", _playlist[trk].c_str() );
@@ -291,5 +358,138 @@ void laproque::JackPlayer::print_status()
     printf("Loop: %s\n", _loop.load() ? "true" : "false" );
     printf("Shuffle: %s\n", _shuffle.load() ? "true" : "false" );
     printf("Autoplay: %s\n", _autoplay.load() ? "true" : "false" );
+    if ( _streaming ) {
+        printf("Prefetched: %lu frames\n", _fifo->get_n_readable() );
+        printf("Underruns: %lu\n", _n_underruns.load() );
+    }
+}
+
+void laproque::JackPlayer::_request_track( unsigned idx )
+{
+    // Count up the request, so the same track can be requested again.
+    unsigned long long request = _request.load();
+    unsigned long long next;
+    do {
+        next = ( ( (request >> 32) + 1 ) << 32 ) | idx;
+    } while ( !_request.compare_exchange_weak( request, next ) );
+}
+
+sf_count_t laproque::JackPlayer::_read_stream( float* output, sf_count_t n_frames )
+{
+    // Play nothing while the reader thread switches to the selected track.
+    unsigned long long served = _served.load( std::memory_order_acquire );
+    if ( served != _request.load( std::memory_order_acquire ) ) return 0;
+    
+    unsigned long long start = _track_start.load( std::memory_order_acquire );
+    unsigned long long end = _track_end.load( std::memory_order_acquire );
+    if ( served != _served.load( std::memory_order_acquire ) ) return 0;
+    
+    // Drop what is left of the previous track.
+    _fifo->skip_to( start );
+    
+    unsigned long long position = _fifo->get_read_position();
+    if ( position >= end ) return 0;
+    
+    sf_count_t wanted = std::min( (unsigned long long)(n_frames), end - position );
+    sf_count_t n_read = _fifo->read( output, (unsigned long)(wanted) );
+    if ( n_read < wanted ) _n_underruns.fetch_add( 1 );
+    
+    return n_read;
+}
+
+bool laproque::JackPlayer::_stream_ended()
+{
+    unsigned long long served = _served.load( std::memory_order_acquire );
+    if ( served != _request.load( std::memory_order_acquire ) ) return false;
+    
+    return _fifo->get_read_position() >= _track_end.load( std::memory_order_acquire );
+}
+
+void laproque::JackPlayer::_stream_audio()
+{
+    SNDFILE* audio_file = nullptr;
+    Resampler* resampler = nullptr;
+    unsigned long long served = 0;
+    
+    // Frames read from the file at once and frames of the track still to be written.
+    unsigned long n_chunk = _stream_chunk;
+    sf_count_t n_left = 0;
+    
+    std::vector<float> chunk( _stream_chunk );
+    std::vector<float> converted;
+    
+    while ( !_quit.load() ) {
+        unsigned long long request = _request.load( std::memory_order_acquire );
+        
+        // Start the requested track.
+        if ( request != served ) {
+            if ( audio_file ) sf_close( audio_file );
+            audio_file = nullptr;
+            delete resampler;
+            resampler = nullptr;
+            
+            unsigned idx = unsigned( request & 0xffffffff );
+            std::string file_path;
+            while ( _playlist_lock.test_and_set( std::memory_order_acquire ) );
+            if ( idx < _playlist.size() ) file_path = _playlist[idx];
+            _playlist_lock.clear( std::memory_order_release );
+            
+            SF_INFO audio_info;
+            if ( !file_path.empty() ) audio_file = sf_open( file_path.c_str(), SFM_READ, &audio_info );
+            
+            if ( audio_file ) {
+                n_chunk = _stream_chunk;
+                n_left = audio_info.frames;
+                
+                // Convert to the rate of the Jack server. One converted chunk must fit into half the FIFO.
+                if ( audio_info.samplerate != int(_sample_rate) ) {
+                    resampler = new Resampler( audio_info.samplerate, _sample_rate );
+                    double ratio = double(_sample_rate) / audio_info.samplerate;
+                    n_chunk = std::max( std::min( n_chunk, (unsigned long)( _fifo->get_size() / 2 / ratio ) ), 1lu );
+                    converted.resize( resampler->get_max_output( n_chunk ) );
+                    n_left = sf_count_t( ceil( audio_info.frames * ratio ) );
+                }
+            }
+            
+            // A file which cannot be read ends right where it starts.
+            unsigned long long start = _fifo->get_write_position();
+            _track_end.store( audio_file ? ULLONG_MAX : start, std::memory_order_release );
+            _track_start.store( start, std::memory_order_release );
+            _served.store( request, std::memory_order_release );
+            served = request;
+        }
+        // Read ahead as long as the FIFO has room.
+        else if ( audio_file && _fifo->get_n_writable() >= ( resampler ? converted.size() : n_chunk ) ) {
+            sf_count_t n_read = sf_read_float( audio_file, &chunk[0], n_chunk );
+            n_read = std::max( n_read, sf_count_t(0) );
+            
+            float* samples = &chunk[0];
+            sf_count_t n_samples = n_read;
+            
+            // Zeros behind the end flush the kernel, like in Resampler::convert().
+            if ( resampler ) {
+                std::fill( chunk.begin() + n_read, chunk.begin() + n_chunk, 0.f );
+                samples = &converted[0];
+                n_samples = sf_count_t( resampler->process( &chunk[0], samples, n_chunk ) );
+            }
+            
+            n_samples = std::min( n_samples, n_left );
+            _fifo->write( samples, (unsigned long)(n_samples) );
+            n_left -= n_samples;
+            
+            // Without conversion the end of the file is the end of the track.
+            if ( n_left == 0 || n_read == 0 || ( !resampler && n_read < sf_count_t(n_chunk) ) ) {
+                _track_end.store( _fifo->get_write_position(), std::memory_order_release );
+                sf_close( audio_file );
+                audio_file = nullptr;
+            }
+        }
+        else {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 2 ) );
+        }
+    }
+    
+    if ( audio_file ) sf_close( audio_file );
+    delete resampler;
 }
 
@@ -0,0 +1,127 @@
+//
+//  ModulatedDelay.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "ModulatedDelay.hpp"
+#include <algorithm>
+#include <math.h>
+
+// The reader needs one sample behind and two ahead of its position.
+laproque::ModulatedDelay::ModulatedDelay( unsigned max_delay, unsigned max_n_taps, unsigned max_block ) :
+_ring( max_delay + 8, 2*max_block + 8 )
+{
+    _max_block = max_block;
+    _max_delay = float(max_delay);
+    _max_n_taps = max_n_taps;
+    
+    _delays.resize( _max_n_taps );
+    _target_delays.resize( _max_n_taps );
+    _end_delays.resize( _max_n_taps );
+    _weights.resize( _max_n_taps );
+    _target_weights.resize( _max_n_taps );
+}
+
+void laproque::ModulatedDelay::process( float* input, float* output, unsigned long n_frames )
+{
+    unsigned tap;
+    float max_change = float(n_frames);
+    
+    // The delays may change by at most one sample per sample. The targets are kept for the next calls.
+    for ( tap = 0; tap < _n_taps; tap++ ) {
+        _end_delays[tap] = std::min( std::max( _target_delays[tap], _delays[tap] - max_change ), _delays[tap] + max_change );
+    }
+    
+    unsigned long n_done = 0;
+    
+    while ( n_done < n_frames ) {
+        unsigned long n_ready = std::min( n_frames - n_done, (unsigned long)(_max_block) );
+        
+        _ring.write( input, n_ready );
+        
+        for ( unsigned long idx = 0; idx < n_ready; idx++ ) {
+            output[idx] = 0.f;
+        }
+        
+        // Position of this block within the process call.
+        float start = float(n_done) / float(n_frames);
+        float end = float(n_done + n_ready) / float(n_frames);
+        
+        for ( tap = 0; tap < _n_taps; tap++ ) {
+            float delay_change = _end_delays[tap] - _delays[tap];
+            float weight_change = _target_weights[tap] - _weights[tap];
+            
+            _ring.add_interpolated( _delays[tap] + delay_change * start, _delays[tap] + delay_change * end,
+                                    _weights[tap] + weight_change * start, _weights[tap] + weight_change * end,
+                                    n_ready, output );
+        }
+        
+        input += n_ready;
+        output += n_ready;
+        n_done += n_ready;
+    }
+    
+    for ( tap = 0; tap < _n_taps; tap++ ) {
+        _delays[tap] = _end_delays[tap];
+        _weights[tap] = _target_weights[tap];
+    }
+}
+
+float laproque::ModulatedDelay::_clip_delay( float delay )
+{
+    return std::min( std::max( delay, 2.f ), _max_delay - 2.f );
+}
+
+void laproque::ModulatedDelay::add_tap( float delay, float weight )
+{
+    if ( _n_taps < _max_n_taps ) {
+        _delays[_n_taps] = _target_delays[_n_taps] = _clip_delay( delay );
+        _weights[_n_taps] = _target_weights[_n_taps] = weight;
+        _n_taps++;
+    }
+}
+
+void laproque::ModulatedDelay::set_tap( unsigned tap, float delay, float weight )
+{
+    if ( tap < _n_taps ) {
+        _target_delays[tap] = _clip_delay( delay );
+        _target_weights[tap] = weight;
+    }
+}
+
+void laproque::ModulatedDelay::set_delays( float* delays )
+{
+    for ( unsigned tap = 0; tap < _n_taps; tap++ ) {
+        _target_delays[tap] = _clip_delay( delays[tap] );
+    }
+}
+
+void laproque::ModulatedDelay::set_weights( float* weights )
+{
+    for ( unsigned tap = 0; tap < _n_taps; tap++ ) {
+        _target_weights[tap] = weights[tap];
+    }
+}
+
+void laproque::ModulatedDelay::clear_taps()
+{
+    _n_taps = 0;
+}
+
+void laproque::ModulatedDelay::reset()
+{
+    _ring.reset();
+}
+
+unsigned laproque::ModulatedDelay::get_n_taps()
+{
+    return _n_taps;
+}
+
+float laproque::ModulatedDelay::get_delay( unsigned tap )
+{
+    return _delays[tap];
+}
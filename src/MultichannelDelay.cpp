@@ -0,0 +1,140 @@
+//
+//  MultichannelDelay.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "MultichannelDelay.hpp"
+#include <algorithm>
+
+#include <xmmintrin.h>
+
+laproque::MultichannelDelay::MultichannelDelay( unsigned n_channels, unsigned max_delay, unsigned max_block )
+{
+    _n_channels = n_channels;
+    _n_groups = (n_channels + 3) / 4;
+    _max_delay = max_delay;
+    _max_block = std::max( max_block, 1u );
+    
+    _size = 1;
+    while ( _size < _max_delay + _max_block ) _size <<= 1;
+    _mask = _size - 1;
+    
+    _history.resize( _n_groups * (_size + _max_block) * 4 );
+    _delays.resize( _n_groups * 4 );
+    _silence.resize( _max_block );
+    _discard.resize( _max_block );
+}
+
+float* laproque::MultichannelDelay::_group_history( unsigned group )
+{
+    return &_history[ group * (_size + _max_block) * 4 ];
+}
+
+void laproque::MultichannelDelay::process( float** input, float** output, unsigned long n_frames )
+{
+    float* group_input[4];
+    float* group_output[4];
+    unsigned long n_done = 0;
+    
+    while ( n_done < n_frames ) {
+        unsigned long n_ready = std::min( n_frames - n_done, _max_block );
+        
+        for ( unsigned group = 0; group < _n_groups; group++ ) {
+            
+            // Unused channels of the last group read silence and write to a dummy.
+            for ( unsigned lane = 0; lane < 4; lane++ ) {
+                unsigned channel = group * 4 + lane;
+                group_input[lane] = channel < _n_channels ? input[channel] + n_done : &_silence[0];
+                group_output[lane] = channel < _n_channels ? output[channel] + n_done : &_discard[0];
+            }
+            
+            float* history = _group_history( group );
+            unsigned long* delays = &_delays[group * 4];
+            unsigned long idx, lane;
+            
+            // Write four channels at once, transposed from separate buffers to frames.
+            for ( idx = 0; idx + 4 <= n_ready; idx += 4 ) {
+                __m128 frame0 = _mm_loadu_ps( group_input[0] + idx );
+                __m128 frame1 = _mm_loadu_ps( group_input[1] + idx );
+                __m128 frame2 = _mm_loadu_ps( group_input[2] + idx );
+                __m128 frame3 = _mm_loadu_ps( group_input[3] + idx );
+                _MM_TRANSPOSE4_PS( frame0, frame1, frame2, frame3 );
+                
+                __m128 frames[4] = { frame0, frame1, frame2, frame3 };
+                for ( unsigned frame = 0; frame < 4; frame++ ) {
+                    unsigned long pos = (_pos + idx + frame) & _mask;
+                    _mm_storeu_ps( history + pos*4, frames[frame] );
+                    if ( pos < _max_block ) _mm_storeu_ps( history + (pos + _size)*4, frames[frame] );
+                }
+            }
+            for ( ; idx < n_ready; idx++ ) {
+                unsigned long pos = (_pos + idx) & _mask;
+                for ( lane = 0; lane < 4; lane++ ) {
+                    history[pos*4 + lane] = group_input[lane][idx];
+                    if ( pos < _max_block ) history[(pos + _size)*4 + lane] = group_input[lane][idx];
+                }
+            }
+            
+            // Start of the block every channel reads, contiguous thanks to the mirror.
+            const float* read[4];
+            for ( lane = 0; lane < 4; lane++ ) {
+                read[lane] = history + ((_pos - delays[lane]) & _mask)*4 + lane;
+            }
+            
+            // Read four channels at once, transposed from frames to separate buffers.
+            for ( idx = 0; idx + 4 <= n_ready; idx += 4 ) {
+                __m128 frame0 = _mm_set_ps( read[3][idx*4], read[2][idx*4], read[1][idx*4], read[0][idx*4] );
+                __m128 frame1 = _mm_set_ps( read[3][idx*4+4], read[2][idx*4+4], read[1][idx*4+4], read[0][idx*4+4] );
+                __m128 frame2 = _mm_set_ps( read[3][idx*4+8], read[2][idx*4+8], read[1][idx*4+8], read[0][idx*4+8] );
+                __m128 frame3 = _mm_set_ps( read[3][idx*4+12], read[2][idx*4+12], read[1][idx*4+12], read[0][idx*4+12] );
+                _MM_TRANSPOSE4_PS( frame0, frame1, frame2, frame3 );
+                
+                _mm_storeu_ps( group_output[0] + idx, frame0 );
+                _mm_storeu_ps( group_output[1] + idx, frame1 );
+                _mm_storeu_ps( group_output[2] + idx, frame2 );
+                _mm_storeu_ps( group_output[3] + idx, frame3 );
+            }
+            for ( ; idx < n_ready; idx++ ) {
+                for ( lane = 0; lane < 4; lane++ ) {
+                    group_output[lane][idx] = read[lane][idx*4];
+                }
+            }
+        }
+        
+        _pos = (_pos + n_ready) & _mask;
+        n_done += n_ready;
+    }
+}
+
+void laproque::MultichannelDelay::set_delay( unsigned channel, unsigned long delay )
+{
+    if ( channel < _n_channels && delay <= _max_delay ) {
+        _delays[channel] = delay;
+    }
+}
+
+void laproque::MultichannelDelay::set_delays( unsigned long* delays )
+{
+    for ( unsigned channel = 0; channel < _n_channels; channel++ ) {
+        set_delay( channel, delays[channel] );
+    }
+}
+
+void laproque::MultichannelDelay::reset()
+{
+    std::fill( _history.begin(), _history.end(), 0.f );
+    _pos = 0;
+}
+
+unsigned laproque::MultichannelDelay::get_n_channels()
+{
+    return _n_channels;
+}
+
+unsigned long laproque::MultichannelDelay::get_delay( unsigned channel )
+{
+    return _delays[channel];
+}
@@ -0,0 +1,296 @@
+//
+//  MultichannelFilter.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "MultichannelFilter.hpp"
+#include <algorithm>
+
+#include <pmmintrin.h>
+
+const unsigned laproque::MultichannelFilter::BLOCK;
+
+/** Number of coefficients and states per lane. */
+static const unsigned N_COEFFS = 5;
+static const unsigned N_STATES = 2;
+
+/** Number of groups whose recursions are interleaved in one loop. */
+static const unsigned N_BATCH = 4;
+
+/** One frame of four first order sections in transposed direct form II. */
+static inline __m128 first_order( __m128 x, const __m128* coeffs, __m128& s1 )
+{
+    __m128 y = _mm_add_ps( _mm_mul_ps( coeffs[0], x ), s1 );
+    s1 = _mm_sub_ps( _mm_mul_ps( coeffs[1], x ), _mm_mul_ps( coeffs[3], y ) );
+    return y;
+}
+
+/** One frame of four second order sections in transposed direct form II. */
+static inline __m128 second_order( __m128 x, const __m128* coeffs, __m128& s1, __m128& s2 )
+{
+    __m128 y = _mm_add_ps( _mm_mul_ps( coeffs[0], x ), s1 );
+    s1 = _mm_add_ps( _mm_sub_ps( _mm_mul_ps( coeffs[1], x ), _mm_mul_ps( coeffs[3], y ) ), s2 );
+    s2 = _mm_sub_ps( _mm_mul_ps( coeffs[2], x ), _mm_mul_ps( coeffs[4], y ) );
+    return y;
+}
+
+/**
+ * Run n_frames frames of N_BATCH consecutive groups through their sections.
+ * Frame f of group g is read from input + f*stride + g*4 and written to the same place in output.
+ * The four independent recursions are written out one after another, so they overlap in the
+ * pipeline and their states stay in registers.
+ */
+static void filter_batch( const float* coeffs, float* states, const float* input, float* output,
+                          unsigned long stride, unsigned long n_frames, laproque::filter_order order )
+{
+    __m128 c[N_BATCH][N_COEFFS];
+    __m128 s1[N_BATCH], s2[N_BATCH];
+    unsigned group, coeff;
+    unsigned long frame;
+    
+    for ( group = 0; group < N_BATCH; group++ ) {
+        for ( coeff = 0; coeff < N_COEFFS; coeff++ ) {
+            c[group][coeff] = _mm_loadu_ps( coeffs + (group * N_COEFFS + coeff) * 4 );
+        }
+        s1[group] = _mm_loadu_ps( states + group * N_STATES * 4 );
+        s2[group] = _mm_loadu_ps( states + group * N_STATES * 4 + 4 );
+    }
+    
+    if ( order == laproque::FIRST_ORDER ) {
+        for ( frame = 0; frame < n_frames; frame++ ) {
+            const float* x = input + frame * stride;
+            float* y = output + frame * stride;
+            _mm_storeu_ps( y, first_order( _mm_loadu_ps( x ), c[0], s1[0] ) );
+            _mm_storeu_ps( y + 4, first_order( _mm_loadu_ps( x + 4 ), c[1], s1[1] ) );
+            _mm_storeu_ps( y + 8, first_order( _mm_loadu_ps( x + 8 ), c[2], s1[2] ) );
+            _mm_storeu_ps( y + 12, first_order( _mm_loadu_ps( x + 12 ), c[3], s1[3] ) );
+        }
+    }
+    else {
+        for ( frame = 0; frame < n_frames; frame++ ) {
+            const float* x = input + frame * stride;
+            float* y = output + frame * stride;
+            _mm_storeu_ps( y, second_order( _mm_loadu_ps( x ), c[0], s1[0], s2[0] ) );
+            _mm_storeu_ps( y + 4, second_order( _mm_loadu_ps( x + 4 ), c[1], s1[1], s2[1] ) );
+            _mm_storeu_ps( y + 8, second_order( _mm_loadu_ps( x + 8 ), c[2], s1[2], s2[2] ) );
+            _mm_storeu_ps( y + 12, second_order( _mm_loadu_ps( x + 12 ), c[3], s1[3], s2[3] ) );
+        }
+    }
+    
+    for ( group = 0; group < N_BATCH; group++ ) {
+        _mm_storeu_ps( states + group * N_STATES * 4, s1[group] );
+        _mm_storeu_ps( states + group * N_STATES * 4 + 4, s2[group] );
+    }
+}
+
+laproque::MultichannelFilter::MultichannelFilter( unsigned n_channels, filter_order order )
+{
+    _n_channels = n_channels;
+    _order = order;
+    
+    // Whole batches of groups are processed. The recursion of a single group is bound by latency,
+    // so the lanes of the unused groups cost hardly any time.
+    _n_groups = (n_channels + 4 * N_BATCH - 1) / (4 * N_BATCH) * N_BATCH;
+    
+    _coeffs.resize( _n_groups * N_COEFFS * 4 );
+    _states.resize( _n_groups * N_STATES * 4 );
+    _frames.resize( BLOCK * N_BATCH * 4 );
+    
+    // Pass the signal through unchanged until coefficients are set.
+    for ( unsigned lane = 0; lane < _n_groups * 4; lane++ ) {
+        _coeffs[(lane / 4) * N_COEFFS * 4 + lane % 4] = 1.f;
+    }
+}
+
+void laproque::MultichannelFilter::process( float** input, float** output, unsigned long n_frames )
+{
+    _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+    
+    unsigned long n_done = 0;
+    
+    while ( n_done < n_frames ) {
+        unsigned long n_ready = std::min( n_frames - n_done, (unsigned long)(BLOCK) );
+        
+        // One batch at a time, so the interleaved frames stay in the cache.
+        for ( unsigned first = 0; first < _n_groups; first += N_BATCH ) {
+            unsigned group;
+            
+            for ( group = first; group < first + N_BATCH && group * 4 < _n_channels; group++ ) {
+                _transpose_in( input, group, n_done, n_ready );
+            }
+            
+            filter_batch( &_coeffs[first * N_COEFFS * 4], &_states[first * N_STATES * 4],
+                          &_frames[0], &_frames[0], N_BATCH * 4, n_ready, _order );
+            
+            for ( group = first; group < first + N_BATCH && group * 4 < _n_channels; group++ ) {
+                _transpose_out( output, group, n_done, n_ready );
+            }
+        }
+        
+        n_done += n_ready;
+    }
+}
+
+void laproque::MultichannelFilter::_transpose_in( float** input, unsigned group, unsigned long offset, unsigned long n_frames )
+{
+    unsigned long stride = N_BATCH * 4;
+    float* frames = &_frames[(group % N_BATCH) * 4];
+    unsigned n_lanes = std::min( _n_channels - group * 4, 4u );
+    unsigned long idx;
+    unsigned lane;
+    
+    if ( n_lanes < 4 ) {
+        for ( idx = 0; idx < n_frames; idx++ ) {
+            for ( lane = 0; lane < n_lanes; lane++ ) {
+                frames[idx * stride + lane] = input[group * 4 + lane][offset + idx];
+            }
+        }
+        return;
+    }
+    
+    float* lanes[4];
+    for ( lane = 0; lane < 4; lane++ ) {
+        lanes[lane] = input[group * 4 + lane] + offset;
+    }
+    
+    for ( idx = 0; idx + 4 <= n_frames; idx += 4 ) {
+        __m128 frame0 = _mm_loadu_ps( lanes[0] + idx );
+        __m128 frame1 = _mm_loadu_ps( lanes[1] + idx );
+        __m128 frame2 = _mm_loadu_ps( lanes[2] + idx );
+        __m128 frame3 = _mm_loadu_ps( lanes[3] + idx );
+        _MM_TRANSPOSE4_PS( frame0, frame1, frame2, frame3 );
+        
+        _mm_storeu_ps( frames + idx * stride, frame0 );
+        _mm_storeu_ps( frames + (idx + 1) * stride, frame1 );
+        _mm_storeu_ps( frames + (idx + 2) * stride, frame2 );
+        _mm_storeu_ps( frames + (idx + 3) * stride, frame3 );
+    }
+    for ( ; idx < n_frames; idx++ ) {
+        for ( lane = 0; lane < 4; lane++ ) {
+            frames[idx * stride + lane] = lanes[lane][idx];
+        }
+    }
+}
+
+void laproque::MultichannelFilter::_transpose_out( float** output, unsigned group, unsigned long offset, unsigned long n_frames )
+{
+    unsigned long stride = N_BATCH * 4;
+    float* frames = &_frames[(group % N_BATCH) * 4];
+    unsigned n_lanes = std::min( _n_channels - group * 4, 4u );
+    unsigned long idx;
+    unsigned lane;
+    
+    if ( n_lanes < 4 ) {
+        for ( idx = 0; idx < n_frames; idx++ ) {
+            for ( lane = 0; lane < n_lanes; lane++ ) {
+                output[group * 4 + lane][offset + idx] = frames[idx * stride + lane];
+            }
+        }
+        return;
+    }
+    
+    float* lanes[4];
+    for ( lane = 0; lane < 4; lane++ ) {
+        lanes[lane] = output[group * 4 + lane] + offset;
+    }
+    
+    for ( idx = 0; idx + 4 <= n_frames; idx += 4 ) {
+        __m128 frame0 = _mm_loadu_ps( frames + idx * stride );
+        __m128 frame1 = _mm_loadu_ps( frames + (idx + 1) * stride );
+        __m128 frame2 = _mm_loadu_ps( frames + (idx + 2) * stride );
+        __m128 frame3 = _mm_loadu_ps( frames + (idx + 3) * stride );
+        _MM_TRANSPOSE4_PS( frame0, frame1, frame2, frame3 );
+        
+        _mm_storeu_ps( lanes[0] + idx, frame0 );
+        _mm_storeu_ps( lanes[1] + idx, frame1 );
+        _mm_storeu_ps( lanes[2] + idx, frame2 );
+        _mm_storeu_ps( lanes[3] + idx, frame3 );
+    }
+    for ( ; idx < n_frames; idx++ ) {
+        for ( lane = 0; lane < 4; lane++ ) {
+            lanes[lane][idx] = frames[idx * stride + lane];
+        }
+    }
+}
+
+void laproque::MultichannelFilter::process_interleaved( float* input, float* output, unsigned long n_frames )
+{
+    _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+    
+    unsigned group;
+    
+    // Full groups are filtered in place.
+    if ( _n_channels == _n_groups * 4 ) {
+        for ( group = 0; group < _n_groups; group += N_BATCH ) {
+            filter_batch( &_coeffs[group * N_COEFFS * 4], &_states[group * N_STATES * 4],
+                          input + group * 4, output + group * 4, _n_channels, n_frames, _order );
+        }
+        return;
+    }
+    
+    // Otherwise the frames are padded to full groups, one batch at a time.
+    unsigned long stride = N_BATCH * 4;
+    unsigned long n_done = 0;
+    
+    while ( n_done < n_frames ) {
+        unsigned long n_ready = std::min( n_frames - n_done, (unsigned long)(BLOCK) );
+        
+        for ( group = 0; group < _n_groups; group += N_BATCH ) {
+            unsigned n_lanes = std::min( _n_channels - std::min( _n_channels, group * 4 ), N_BATCH * 4 );
+            float* first_input = input + n_done * _n_channels + group * 4;
+            float* first_output = output + n_done * _n_channels + group * 4;
+            unsigned long idx;
+            
+            for ( idx = 0; idx < n_ready; idx++ ) {
+                std::copy( first_input + idx * _n_channels, first_input + idx * _n_channels + n_lanes, &_frames[idx * stride] );
+            }
+            
+            filter_batch( &_coeffs[group * N_COEFFS * 4], &_states[group * N_STATES * 4],
+                          &_frames[0], &_frames[0], stride, n_ready, _order );
+            
+            for ( idx = 0; idx < n_ready; idx++ ) {
+                std::copy( &_frames[idx * stride], &_frames[idx * stride] + n_lanes, first_output + idx * _n_channels );
+            }
+        }
+        
+        n_done += n_ready;
+    }
+}
+
+void laproque::MultichannelFilter::set_coeffs( unsigned channel, float* b_coeffs, float* a_coeffs )
+{
+    if ( channel >= _n_channels || a_coeffs[0] == 0.f ) return;
+    
+    float* coeffs = &_coeffs[(channel / 4) * N_COEFFS * 4 + channel % 4];
+    float norm = 1.f / a_coeffs[0];
+    
+    coeffs[0] = b_coeffs[0] * norm;
+    coeffs[4] = b_coeffs[1] * norm;
+    coeffs[12] = a_coeffs[1] * norm;
+    
+    if ( _order == SECOND_ORDER ) {
+        coeffs[8] = b_coeffs[2] * norm;
+        coeffs[16] = a_coeffs[2] * norm;
+    }
+}
+
+void laproque::MultichannelFilter::set_filter( unsigned channel, Filter& filter )
+{
+    float b_coeffs[3] = { 0.f, 0.f, 0.f };
+    float a_coeffs[3] = { 1.f, 0.f, 0.f };
+    filter.get_coeffs( b_coeffs, a_coeffs );
+    set_coeffs( channel, b_coeffs, a_coeffs );
+}
+
+void laproque::MultichannelFilter::reset()
+{
+    std::fill( _states.begin(), _states.end(), 0.f );
+}
+
+unsigned laproque::MultichannelFilter::get_n_channels()
+{
+    return _n_channels;
+}
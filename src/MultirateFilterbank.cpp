@@ -0,0 +1,409 @@
+//
+//  MultirateFilterbank.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.
+//
+
+#include "MultirateFilterbank.hpp"
+#include <math.h>
+#include <algorithm>
+#include <cstring>
+#include <xmmintrin.h>
+
+/** The halfband filter has 2 * HALF_LENGTH + 1 taps. Must be odd. */
+static const unsigned HALF_LENGTH = 11;
+
+/** A crossover runs at the lowest level whose sample rate is at least this many times its frequency. */
+static const unsigned LEVEL_RATIO = 16;
+
+/** Writes the input times weight to output. */
+static inline void scale( const float* input, float weight, float* output, unsigned long n_frames )
+{
+    __m128 factor = _mm_set1_ps( weight );
+    unsigned long idx = 0;
+    for ( ; idx + 4 <= n_frames; idx += 4 ) {
+        _mm_storeu_ps( output + idx, _mm_mul_ps( factor, _mm_loadu_ps( input + idx ) ) );
+    }
+    for ( ; idx < n_frames; idx++ ) {
+        output[idx] = weight * input[idx];
+    }
+}
+
+/** Adds the input times weight to output. */
+static inline void add_weighted( const float* input, float weight, float* output, unsigned long n_frames )
+{
+    __m128 factor = _mm_set1_ps( weight );
+    unsigned long idx = 0;
+    for ( ; idx + 4 <= n_frames; idx += 4 ) {
+        __m128 result = _mm_add_ps( _mm_loadu_ps( output + idx ), _mm_mul_ps( factor, _mm_loadu_ps( input + idx ) ) );
+        _mm_storeu_ps( output + idx, result );
+    }
+    for ( ; idx < n_frames; idx++ ) {
+        output[idx] += weight * input[idx];
+    }
+}
+
+laproque::MultirateFilterbank::MultirateFilterbank(
+                                                   std::vector<float> co_freqs
+                                                   , unsigned sample_rate
+                                                   )
+{
+    _crossover_freqs = co_freqs;
+    _sample_rate = sample_rate;
+    _n_bands = unsigned(co_freqs.size()) + 1;
+
+    // Blackman windowed halfband lowpass. Every second tap is zero apart from the center.
+    _taps.resize( HALF_LENGTH + 1 );
+    double sum = 0.;
+    for ( unsigned tap = 0; tap <= HALF_LENGTH; tap++ ) {
+        double x_val = ( double(2*tap) - HALF_LENGTH ) * 0.5 * M_PI;
+        double phase = 2. * M_PI * 2*tap / (2*HALF_LENGTH);
+        double window = 0.42 - 0.5 * cos( phase ) + 0.08 * cos( 2*phase );
+        _taps[tap] = float( 0.5 * sin( x_val ) / x_val * window );
+        sum += _taps[tap];
+    }
+    // Both polyphase components have a gain of 0.5.
+    for ( unsigned tap = 0; tap <= HALF_LENGTH; tap++ ) {
+        _taps[tap] *= float( 0.5 / sum );
+    }
+
+    // Assign every crossover to the lowest sufficient level.
+    std::vector<unsigned> co_levels( co_freqs.size() );
+    _n_levels = 1;
+    for ( unsigned co = 0; co < co_freqs.size(); co++ ) {
+        unsigned level = 0;
+        while ( co_freqs[co] * LEVEL_RATIO * 2 <= float(sample_rate >> level) && (sample_rate >> (level+1)) ) {
+            level++;
+        }
+        co_levels[co] = level;
+        _n_levels = std::max( _n_levels, level + 1 );
+    }
+
+    _levels.resize( _n_levels );
+    for ( unsigned lvl = 0; lvl < _n_levels; lvl++ ) {
+        _Level& level = _levels[lvl];
+        level.sample_rate = sample_rate >> lvl;
+        level.parent_band = lvl ? _levels[lvl-1].low_band : _n_bands;
+        level.low_band = lvl ? level.parent_band : _n_bands - 1;
+
+        for ( unsigned co = unsigned(co_freqs.size()); co--; ) {
+            if ( co_levels[co] == lvl ) {
+                level.crossovers.push_back( co );
+                level.filters.push_back( Filter( LOW, co_freqs[co], level.sample_rate ) );
+                level.filters.push_back( Filter( HIGH, co_freqs[co], level.sample_rate ) );
+                level.low_band = co;
+            }
+        }
+
+        unsigned buff_size = ( _intern_buff_size >> lvl ) + 1;
+        level.input.resize( buff_size );
+        level.highs.resize( level.crossovers.size(), std::vector<float>( buff_size ) );
+        level.low_a.resize( buff_size );
+        level.low_b.resize( buff_size );
+        level.history.resize( 2*HALF_LENGTH + buff_size );
+    }
+
+    // Each level waits for the decimated and interpolated levels below.
+    _levels[_n_levels-1].latency = 0;
+    for ( unsigned lvl = _n_levels-1; lvl--; ) {
+        _levels[lvl].latency = 2*HALF_LENGTH + 2*_levels[lvl+1].latency;
+    }
+
+    _band_mixers.resize( _n_bands );
+    for ( unsigned band = 0; band < _n_bands; band++ ) {
+        std::vector<float> weights( _n_bands, 0.f );
+        weights[band] = 1.f;
+        _create_mixer( _band_mixers[band], weights );
+    }
+    _create_mixer( _mixer, std::vector<float>( _n_bands, 1.f ) );
+    // The weights of process_mix() may change, so all levels are kept running.
+    _mixer.depth = _n_levels - 1;
+
+    reset();
+}
+
+laproque::MultirateFilterbank::~MultirateFilterbank()
+{
+    for ( unsigned band = 0; band < _n_bands; band++ ) {
+        _delete_mixer( _band_mixers[band] );
+    }
+    _delete_mixer( _mixer );
+}
+
+void laproque::MultirateFilterbank::_create_mixer( _Mixer& mixer, std::vector<float> weights )
+{
+    mixer.weights = weights;
+
+    // A band contributes to its own level and the level below, where it is the parent band.
+    mixer.depth = 0;
+    for ( unsigned lvl = 0; lvl < _n_levels; lvl++ ) {
+        _Level& level = _levels[lvl];
+        bool used = weights[level.low_band] != 0.f;
+        for ( unsigned co = 0; co < level.crossovers.size(); co++ ) {
+            used = used || weights[level.crossovers[co]+1] != 0.f;
+        }
+        if ( lvl && weights[level.parent_band] != 0.f ) {
+            used = true;
+        }
+        if ( used ) {
+            mixer.depth = lvl;
+        }
+    }
+
+    mixer.delays.resize( _n_levels );
+    mixer.sums.resize( _n_levels );
+    mixer.history.resize( _n_levels );
+    mixer.fifo.resize( _n_levels );
+    mixer.fifo_fill.resize( _n_levels );
+    for ( unsigned lvl = 0; lvl < _n_levels; lvl++ ) {
+        unsigned buff_size = ( _intern_buff_size >> lvl ) + 1;
+        unsigned long latency = _levels[lvl].latency;
+        mixer.delays[lvl] = new Delay( unsigned(latency), unsigned(latency) + 1 );
+        mixer.sums[lvl].resize( buff_size );
+        mixer.history[lvl].resize( HALF_LENGTH + buff_size );
+        mixer.fifo[lvl].resize( 2*buff_size + 2 );
+    }
+}
+
+void laproque::MultirateFilterbank::_delete_mixer( _Mixer& mixer )
+{
+    for ( unsigned lvl = 0; lvl < mixer.delays.size(); lvl++ ) {
+        delete mixer.delays[lvl];
+    }
+}
+
+void laproque::MultirateFilterbank::_reset_mixer( _Mixer& mixer )
+{
+    for ( unsigned lvl = 0; lvl < _n_levels; lvl++ ) {
+        mixer.delays[lvl]->reset();
+        std::fill( mixer.history[lvl].begin(), mixer.history[lvl].end(), 0.f );
+        // One sample in advance covers a decimated block which is one sample short.
+        std::fill( mixer.fifo[lvl].begin(), mixer.fifo[lvl].end(), 0.f );
+        mixer.fifo_fill[lvl] = 1;
+    }
+}
+
+void laproque::MultirateFilterbank::process( float* input, float** output, unsigned long n_frames )
+{
+    unsigned long n_ready;
+
+    for ( unsigned long done = 0; done < n_frames; done += n_ready ) {
+        n_ready = std::min( n_frames - done, (unsigned long)(_intern_buff_size) );
+
+        _split( input + done, n_ready );
+        for ( unsigned band = 0; band < _n_bands; band++ ) {
+            _mix( _band_mixers[band], output[band] + done );
+        }
+    }
+}
+
+void laproque::MultirateFilterbank::process_mix( float* input, float* output, unsigned long n_frames )
+{
+    unsigned long n_ready;
+
+    for ( unsigned long done = 0; done < n_frames; done += n_ready ) {
+        n_ready = std::min( n_frames - done, (unsigned long)(_intern_buff_size) );
+
+        _split( input + done, n_ready );
+        _mix( _mixer, output + done );
+    }
+}
+
+void laproque::MultirateFilterbank::_split( float* input, unsigned long n_frames )
+{
+    float* level_input = input;
+
+    for ( unsigned lvl = 0; lvl < _n_levels; lvl++ ) {
+        _Level& level = _levels[lvl];
+        level.n_frames = n_frames;
+        if ( lvl ) {
+            level_input = level.input.data();
+        }
+
+        // Same order as in the Filterbank, highest crossover first.
+        // A short block may leave no samples for the lower levels, which Filter can not process.
+        level.low = level_input;
+        for ( unsigned co = 0; co < level.crossovers.size() && n_frames; co++ ) {
+            float* low_out = level.low == level.low_a.data() ? level.low_b.data() : level.low_a.data();
+            level.filters[2*co+1].process( level.low, level.highs[co].data(), n_frames );
+            level.filters[2*co].process( level.low, low_out, n_frames );
+            level.low = low_out;
+        }
+
+        if ( lvl + 1 < _n_levels ) {
+            _decimate( lvl );
+            n_frames = _levels[lvl+1].n_frames;
+        }
+    }
+}
+
+void laproque::MultirateFilterbank::_decimate( unsigned lvl )
+{
+    _Level& level = _levels[lvl];
+    float* history = level.history.data();
+    float* output = _levels[lvl+1].input.data();
+    const float* taps = _taps.data();
+    unsigned long n_out = 0;
+
+    memcpy( history + 2*HALF_LENGTH, level.low, level.n_frames * sizeof(float) );
+
+    unsigned long idx = 2*HALF_LENGTH + 1 - level.parity;
+    unsigned long end = 2*HALF_LENGTH + level.n_frames;
+
+    // Four outputs at once from every second sample.
+    __m128 half = _mm_set1_ps( 0.5f );
+    for ( ; idx + 6 < end; idx += 8 ) {
+        float* samples = history + idx - HALF_LENGTH;
+        __m128 result = _mm_mul_ps( half, _mm_shuffle_ps( _mm_loadu_ps( samples ), _mm_loadu_ps( samples + 4 ), _MM_SHUFFLE(2, 0, 2, 0) ) );
+        for ( unsigned tap = 0; tap <= HALF_LENGTH; tap++ ) {
+            samples = history + idx - 2*tap;
+            __m128 even = _mm_shuffle_ps( _mm_loadu_ps( samples ), _mm_loadu_ps( samples + 4 ), _MM_SHUFFLE(2, 0, 2, 0) );
+            result = _mm_add_ps( result, _mm_mul_ps( _mm_set1_ps( taps[tap] ), even ) );
+        }
+        _mm_storeu_ps( output + n_out, result );
+        n_out += 4;
+    }
+
+    for ( ; idx < end; idx += 2 ) {
+        float* samples = history + idx;
+        float result = 0.5f * samples[-long(HALF_LENGTH)];
+        for ( unsigned tap = 0; tap <= HALF_LENGTH; tap++ ) {
+            result += taps[tap] * samples[-long(2*tap)];
+        }
+        output[n_out++] = result;
+    }
+
+    level.parity = ( level.parity + level.n_frames ) & 1;
+    _levels[lvl+1].n_frames = n_out;
+
+    memmove( history, history + level.n_frames, 2*HALF_LENGTH * sizeof(float) );
+}
+
+void laproque::MultirateFilterbank::_mix( _Mixer& mixer, float* output )
+{
+    for ( unsigned lvl = mixer.depth + 1; lvl--; ) {
+        _Level& level = _levels[lvl];
+        float* sum = lvl ? mixer.sums[lvl].data() : output;
+        unsigned long n_frames = level.n_frames;
+
+        // The level above counts its whole low signal to its low band. The decimated part arrives
+        // here as input and is taken back out of that band.
+        scale( level.low, mixer.weights[level.low_band], sum, n_frames );
+        if ( lvl && mixer.weights[level.parent_band] != 0.f ) {
+            add_weighted( level.input.data(), -mixer.weights[level.parent_band], sum, n_frames );
+        }
+        for ( unsigned co = 0; co < level.crossovers.size(); co++ ) {
+            float weight = mixer.weights[level.crossovers[co]+1];
+            if ( weight != 0.f ) {
+                add_weighted( level.highs[co].data(), weight, sum, n_frames );
+            }
+        }
+
+        mixer.delays[lvl]->process( sum, sum, n_frames );
+
+        if ( lvl < mixer.depth ) {
+            _interpolate( mixer, lvl );
+
+            float* fifo = mixer.fifo[lvl].data();
+            add_weighted( fifo, 1.f, sum, n_frames );
+            mixer.fifo_fill[lvl] -= n_frames;
+            memmove( fifo, fifo + n_frames, mixer.fifo_fill[lvl] * sizeof(float) );
+        }
+    }
+}
+
+void laproque::MultirateFilterbank::_interpolate( _Mixer& mixer, unsigned lvl )
+{
+    float* history = mixer.history[lvl].data();
+    float* fifo = mixer.fifo[lvl].data() + mixer.fifo_fill[lvl];
+    const float* taps = _taps.data();
+    unsigned long n_in = _levels[lvl+1].n_frames;
+
+    memcpy( history + HALF_LENGTH, mixer.sums[lvl+1].data(), n_in * sizeof(float) );
+
+    // Zero stuffing halves the gain, which the factor 2 restores. The center tap of 0.5 becomes a copy.
+    unsigned long idx = HALF_LENGTH;
+    for ( ; idx + 4 <= HALF_LENGTH + n_in; idx += 4 ) {
+        __m128 even = _mm_setzero_ps();
+        for ( unsigned tap = 0; tap <= HALF_LENGTH; tap++ ) {
+            even = _mm_add_ps( even, _mm_mul_ps( _mm_set1_ps( taps[tap] ), _mm_loadu_ps( history + idx - tap ) ) );
+        }
+        even = _mm_add_ps( even, even );
+        __m128 odd = _mm_loadu_ps( history + idx - (HALF_LENGTH-1)/2 );
+        _mm_storeu_ps( fifo, _mm_unpacklo_ps( even, odd ) );
+        _mm_storeu_ps( fifo + 4, _mm_unpackhi_ps( even, odd ) );
+        fifo += 8;
+    }
+
+    for ( ; idx < HALF_LENGTH + n_in; idx++ ) {
+        float* samples = history + idx;
+        float result = 0.f;
+        for ( unsigned tap = 0; tap <= HALF_LENGTH; tap++ ) {
+            result += taps[tap] * samples[-long(tap)];
+        }
+        *fifo++ = 2.f * result;
+        *fifo++ = samples[-long((HALF_LENGTH-1)/2)];
+    }
+    mixer.fifo_fill[lvl] += 2*n_in;
+
+    memmove( history, history + n_in, HALF_LENGTH * sizeof(float) );
+}
+
+void laproque::MultirateFilterbank::set_band_weights( std::vector<float> weights )
+{
+    if ( weights.size() == _n_bands ) {
+        _mixer.weights = weights;
+    }
+}
+
+void laproque::MultirateFilterbank::set_co_freqs( std::vector<float> co_freqs )
+{
+    if ( co_freqs.size() != _crossover_freqs.size() ) {
+        return;
+    }
+
+    for ( unsigned lvl = 0; lvl < _n_levels; lvl++ ) {
+        _Level& level = _levels[lvl];
+        for ( unsigned co = 0; co < level.crossovers.size(); co++ ) {
+            float freq = std::min( co_freqs[level.crossovers[co]], level.sample_rate * 0.25f );
+            _crossover_freqs[level.crossovers[co]] = freq;
+            level.filters[2*co].set_cutoff_freq( freq );
+            level.filters[2*co+1].set_cutoff_freq( freq );
+        }
+    }
+}
+
+void laproque::MultirateFilterbank::reset()
+{
+    for ( unsigned lvl = 0; lvl < _n_levels; lvl++ ) {
+        _Level& level = _levels[lvl];
+        for ( unsigned flt = 0; flt < level.filters.size(); flt++ ) {
+            level.filters[flt].reset();
+        }
+        std::fill( level.history.begin(), level.history.end(), 0.f );
+        level.parity = 0;
+        level.n_frames = 0;
+    }
+
+    for ( unsigned band = 0; band < _n_bands; band++ ) {
+        _reset_mixer( _band_mixers[band] );
+    }
+    _reset_mixer( _mixer );
+}
+
+unsigned laproque::MultirateFilterbank::get_n_bands()
+{
+    return _n_bands;
+}
+
+unsigned laproque::MultirateFilterbank::get_n_levels()
+{
+    return _n_levels;
+}
+
+unsigned long laproque::MultirateFilterbank::get_latency()
+{
+    return _levels[0].latency;
+}
@@ -0,0 +1,121 @@
+//
+//  PagePool.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "PagePool.hpp"
+#include <cstring>
+
+laproque::PagePool::PagePool( unsigned long page_size, unsigned long max_block )
+{
+    _page_size = 1;
+    while ( _page_size < page_size ) _page_size <<= 1;
+    _max_block = max_block;
+    
+    _zero_page = new float[_page_size + _max_block];
+    std::memset( _zero_page, 0, (_page_size + _max_block)*sizeof(float) );
+}
+
+laproque::PagePool::~PagePool()
+{
+    for ( unsigned long page = 0; page < _all_pages.size(); page++ ) {
+        delete [] _all_pages[page];
+    }
+    delete [] _zero_page;
+}
+
+float* laproque::PagePool::_allocate()
+{
+    float* page = new float[_page_size + _max_block];
+    _all_pages.push_back( page );
+    return page;
+}
+
+float* laproque::PagePool::acquire()
+{
+    while ( _lock.test_and_set( std::memory_order_acquire ) );
+    
+    float* page;
+    if ( _free_pages.empty() ) {
+        // Never allocate on the processing thread once pages were reserved.
+        if ( _reserved ) {
+            _n_failed++;
+            _lock.clear( std::memory_order_release );
+            return _zero_page;
+        }
+        page = _allocate();
+    }
+    else {
+        page = _free_pages.back();
+        _free_pages.pop_back();
+    }
+    
+    _lock.clear( std::memory_order_release );
+    
+    // Pages are only zeroed when they are used.
+    std::memset( page, 0, (_page_size + _max_block)*sizeof(float) );
+    return page;
+}
+
+void laproque::PagePool::release( float* page )
+{
+    while ( _lock.test_and_set( std::memory_order_acquire ) );
+    _free_pages.push_back( page );
+    _lock.clear( std::memory_order_release );
+}
+
+void laproque::PagePool::reserve( unsigned long n_pages )
+{
+    while ( _lock.test_and_set( std::memory_order_acquire ) );
+    
+    // Free list must hold all pages without reallocating in release.
+    _free_pages.reserve( _all_pages.size() + n_pages );
+    while ( _free_pages.size() < n_pages ) {
+        _free_pages.push_back( _allocate() );
+    }
+    _reserved = true;
+    
+    _lock.clear( std::memory_order_release );
+}
+
+const float* laproque::PagePool::get_zero_page()
+{
+    return _zero_page;
+}
+
+unsigned long laproque::PagePool::get_page_size()
+{
+    return _page_size;
+}
+
+unsigned long laproque::PagePool::get_max_block()
+{
+    return _max_block;
+}
+
+unsigned long laproque::PagePool::get_n_used()
+{
+    while ( _lock.test_and_set( std::memory_order_acquire ) );
+    unsigned long n_used = _all_pages.size() - _free_pages.size();
+    _lock.clear( std::memory_order_release );
+    return n_used;
+}
+
+unsigned long laproque::PagePool::get_n_allocated()
+{
+    while ( _lock.test_and_set( std::memory_order_acquire ) );
+    unsigned long n_allocated = _all_pages.size();
+    _lock.clear( std::memory_order_release );
+    return n_allocated;
+}
+
+unsigned long laproque::PagePool::get_n_failed()
+{
+    while ( _lock.test_and_set( std::memory_order_acquire ) );
+    unsigned long n_failed = _n_failed;
+    _lock.clear( std::memory_order_release );
+    return n_failed;
+}
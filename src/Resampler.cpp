@@ -0,0 +1,143 @@
+//
+//  Resampler.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.
+//
+
+#include "Resampler.hpp"
+#include <math.h>
+#include <algorithm>
+#include <cstring>
+#include <xmmintrin.h>
+
+laproque::Resampler::Resampler( double in_rate, double out_rate, unsigned n_taps, unsigned n_phases, unsigned max_block )
+{
+    _in_rate = in_rate;
+    _out_rate = out_rate;
+    _step = in_rate / out_rate;
+    _n_phases = std::max( n_phases, 1u );
+    _max_block = max_block;
+
+    // Stretch the kernel when the output rate is lower, so the cutoff follows the output Nyquist frequency.
+    double ratio = std::min( 1., out_rate / in_rate );
+    n_taps = std::max( n_taps, 4u );
+    _n_taps = unsigned( ceil( n_taps / ratio / 4. ) ) * 4;
+
+    // The -6 dB point lies half the blackman transition width below the lower Nyquist frequency.
+    double cutoff_norm = ratio * ( 0.5 - 2.75 / n_taps );
+
+    _kernels.resize( (_n_phases + 1) * _n_taps );
+    for ( unsigned phase = 0; phase <= _n_phases; phase++ ) {
+        float* kernel = &_kernels[phase * _n_taps];
+        double sum = 0.;
+
+        for ( unsigned tap = 0; tap < _n_taps; tap++ ) {
+            // Distance of the tap from the output position in input samples.
+            double x_val = double(tap) - ( _n_taps/2 - 1 ) - double(phase) / _n_phases;
+            double window = 0.42 + 0.5 * cos( 2*M_PI * x_val / _n_taps ) + 0.08 * cos( 4*M_PI * x_val / _n_taps );
+            double sinc = x_val == 0. ? 1. : sin( 2*M_PI * cutoff_norm * x_val ) / ( 2*M_PI * cutoff_norm * x_val );
+            kernel[tap] = float( 2. * cutoff_norm * sinc * window );
+            sum += kernel[tap];
+        }
+
+        // Unity gain at DC for every position.
+        for ( unsigned tap = 0; tap < _n_taps; tap++ ) {
+            kernel[tap] = float( kernel[tap] / sum );
+        }
+    }
+
+    _history.resize( _n_taps + _max_block );
+    reset();
+}
+
+unsigned long laproque::Resampler::process( float* input, float* output, unsigned long n_frames )
+{
+    unsigned long n_out = 0;
+    unsigned long n_ready;
+    float* history = _history.data();
+
+    for ( unsigned long done = 0; done < n_frames; done += n_ready ) {
+        n_ready = std::min( n_frames - done, (unsigned long)(_max_block) );
+
+        memcpy( history + _n_history, input + done, n_ready * sizeof(float) );
+        _n_history += n_ready;
+
+        while ( _first_tap + _n_taps <= _n_history ) {
+            double position = _fraction * _n_phases;
+            unsigned phase = std::min( unsigned(position), _n_phases - 1 );
+            __m128 weight = _mm_set1_ps( float( position - phase ) );
+
+            const float* kernel = &_kernels[phase * _n_taps];
+            const float* next_kernel = kernel + _n_taps;
+            const float* samples = history + _first_tap;
+
+            // Both neighbouring kernels at once, then interpolate the two results.
+            __m128 sum = _mm_setzero_ps();
+            __m128 next_sum = _mm_setzero_ps();
+            for ( unsigned tap = 0; tap < _n_taps; tap += 4 ) {
+                __m128 values = _mm_loadu_ps( samples + tap );
+                sum = _mm_add_ps( sum, _mm_mul_ps( values, _mm_loadu_ps( kernel + tap ) ) );
+                next_sum = _mm_add_ps( next_sum, _mm_mul_ps( values, _mm_loadu_ps( next_kernel + tap ) ) );
+            }
+            sum = _mm_add_ps( sum, _mm_mul_ps( weight, _mm_sub_ps( next_sum, sum ) ) );
+            sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+            sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, 1 ) );
+            output[n_out++] = _mm_cvtss_f32( sum );
+
+            _fraction += _step;
+            double advance = floor( _fraction );
+            _first_tap += (unsigned long)( advance );
+            _fraction -= advance;
+        }
+
+        // Keep what later outputs need. When the step is large, the next first tap can lie in future input.
+        unsigned long used = std::min( _first_tap, _n_history );
+        memmove( history, history + used, (_n_history - used) * sizeof(float) );
+        _n_history -= used;
+        _first_tap -= used;
+    }
+
+    return n_out;
+}
+
+void laproque::Resampler::convert( float* input, unsigned long n_frames, std::vector<float>& output )
+{
+    reset();
+
+    unsigned long n_out = (unsigned long)( ceil( n_frames * _out_rate / _in_rate ) );
+    std::vector<float> zeros( _n_taps, 0.f );
+
+    // The zeros flush the kernel past the last input sample.
+    output.resize( get_max_output( n_frames ) + get_max_output( _n_taps ) );
+    unsigned long n_done = process( input, output.data(), n_frames );
+    process( zeros.data(), output.data() + n_done, _n_taps );
+    output.resize( n_out );
+
+    reset();
+}
+
+void laproque::Resampler::reset()
+{
+    // Zeros before the first input sample, so the first output lies exactly on it.
+    std::fill( _history.begin(), _history.end(), 0.f );
+    _n_history = _n_taps/2 - 1;
+    _first_tap = 0;
+    _fraction = 0.;
+}
+
+unsigned long laproque::Resampler::get_max_output( unsigned long n_frames )
+{
+    return (unsigned long)( n_frames / _step ) + 2;
+}
+
+unsigned laproque::Resampler::get_latency()
+{
+    return _n_taps/2;
+}
+
+unsigned laproque::Resampler::get_n_taps()
+{
+    return _n_taps;
+}
@@ -0,0 +1,516 @@
+//
+//  RingBuffer.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "RingBuffer.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include <math.h>
+
+#include <immintrin.h>
+
+/** Number of samples converted at once when reading 16 bit formats. */
+static const unsigned long CONVERT_BLOCK = 256;
+
+static const float INT16_SCALE = 32767.f;
+
+// IEEE half precision conversion with rounding to nearest even.
+static uint16_t float_to_half( float value )
+{
+    uint32_t bits;
+    std::memcpy( &bits, &value, sizeof(bits) );
+    
+    uint16_t sign = uint16_t( (bits >> 16) & 0x8000 );
+    uint32_t abs_bits = bits & 0x7fffffff;
+    
+    // Infinity and NaN, or too large to be represented.
+    if ( abs_bits >= 0x477ff000 ) {
+        return sign | ( abs_bits > 0x7f800000 ? 0x7e00 : 0x7c00 );
+    }
+    
+    // Subnormal half, steps of 2^-24.
+    if ( abs_bits < 0x38800000 ) {
+        float abs_value;
+        std::memcpy( &abs_value, &abs_bits, sizeof(abs_value) );
+        return sign | uint16_t( lrintf( abs_value * 16777216.f ) );
+    }
+    
+    abs_bits += 0xfff + ((abs_bits >> 13) & 1);
+    return sign | uint16_t( (abs_bits - 0x38000000) >> 13 );
+}
+
+static float half_to_float( uint16_t half )
+{
+    uint32_t sign = uint32_t(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+    
+    if ( exponent == 0 ) {
+        float value = float(mantissa) / 16777216.f;
+        return sign ? -value : value;
+    }
+    else if ( exponent == 31 ) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    
+    float value;
+    std::memcpy( &value, &bits, sizeof(value) );
+    return value;
+}
+
+__attribute__((target("f16c")))
+static void store_half_f16c( const float* input, unsigned long n_frames, uint16_t* dest )
+{
+    unsigned long idx = 0;
+    for ( ; idx + 8 <= n_frames; idx += 8 ) {
+        __m128i low = _mm_cvtps_ph( _mm_loadu_ps( input + idx ), _MM_FROUND_TO_NEAREST_INT );
+        __m128i high = _mm_cvtps_ph( _mm_loadu_ps( input + idx + 4 ), _MM_FROUND_TO_NEAREST_INT );
+        _mm_storeu_si128( (__m128i*)(dest + idx), _mm_unpacklo_epi64( low, high ) );
+    }
+    for ( ; idx < n_frames; idx++ ) {
+        dest[idx] = float_to_half( input[idx] );
+    }
+}
+
+__attribute__((target("f16c")))
+static void load_half_f16c( const uint16_t* source, unsigned long n_frames, float* output )
+{
+    unsigned long idx = 0;
+    for ( ; idx + 8 <= n_frames; idx += 8 ) {
+        __m128i halves = _mm_loadu_si128( (const __m128i*)(source + idx) );
+        _mm_storeu_ps( output + idx, _mm_cvtph_ps( halves ) );
+        _mm_storeu_ps( output + idx + 4, _mm_cvtph_ps( _mm_unpackhi_epi64( halves, halves ) ) );
+    }
+    for ( ; idx < n_frames; idx++ ) {
+        output[idx] = half_to_float( source[idx] );
+    }
+}
+
+// Cubic Hermite interpolation between x0 and x1 at fraction frac.
+static inline float hermite( const float* samples, float frac )
+{
+    float xm1 = samples[-1], x0 = samples[0], x1 = samples[1], x2 = samples[2];
+    
+    float c1 = 0.5f * (x1 - xm1);
+    float c2 = xm1 - 2.5f * x0 + 2.f * x1 - 0.5f * x2;
+    float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+    
+    return ((c3 * frac + c2) * frac + c1) * frac + x0;
+}
+
+static const bool has_f16c = __builtin_cpu_supports( "f16c" );
+
+laproque::RingBuffer::RingBuffer( unsigned long min_size, unsigned long max_block, PagePool* pool, sample_format format )
+{
+    _pool = pool;
+    _format = format;
+    _sample_bytes = _format == FLOAT32 ? sizeof(float) : sizeof(int16_t);
+    
+    // Pool pages hold more samples of a smaller format.
+    unsigned long samples_per_float = sizeof(float) / _sample_bytes;
+    
+    _max_block = std::max( max_block, 1lu );
+    if ( _pool ) _max_block = std::min( _max_block, _pool->get_max_block() * samples_per_float );
+
+    // Round up to the next power of two.
+    // A paged history also holds one more page, so the page the writer enters has expired.
+    unsigned long pool_page_size = _pool ? _pool->get_page_size() * samples_per_float : 0;
+    _size = 1;
+    while ( _size < min_size + _max_block + pool_page_size ) _size <<= 1;
+    _mask = _size - 1;
+    
+    _page_size = _pool ? pool_page_size : _size;
+    _page_mask = _page_size - 1;
+    _page_shift = 0;
+    while ( (1lu << _page_shift) < _page_size ) _page_shift++;
+    _n_pages = _size / _page_size;
+    
+    _pages = new float*[_n_pages];
+    if ( _pool ) {
+        for ( unsigned long page = 0; page < _n_pages; page++ ) {
+            _pages[page] = const_cast< float* >( _pool->get_zero_page() );
+        }
+    }
+    else {
+        _pages[0] = new float[ ((_size + _max_block) * _sample_bytes + sizeof(float) - 1) / sizeof(float) ];
+    }
+    
+    reset();
+}
+
+laproque::RingBuffer::~RingBuffer()
+{
+    if ( _pool ) {
+        for ( unsigned long page = 0; page < _n_pages; page++ ) {
+            _release( page );
+        }
+    }
+    else {
+        delete [] _pages[0];
+    }
+    delete [] _pages;
+}
+
+bool laproque::RingBuffer::_is_acquired( unsigned long page )
+{
+    return _pages[page] != _pool->get_zero_page();
+}
+
+bool laproque::RingBuffer::_get_writable( unsigned long page )
+{
+    if ( !_pool ) return true;
+    
+    if ( !_is_acquired( page ) ) {
+        _pages[page] = _pool->acquire();
+    }
+    return _is_acquired( page );
+}
+
+void laproque::RingBuffer::_release( unsigned long page )
+{
+    if ( _is_acquired( page ) ) {
+        _pool->release( _pages[page] );
+        _pages[page] = const_cast< float* >( _pool->get_zero_page() );
+    }
+}
+
+bool laproque::RingBuffer::_is_silent( const float* input, unsigned long n_frames )
+{
+    for ( unsigned long idx = 0; idx < n_frames; idx++ ) {
+        if ( input[idx] != 0.f ) return false;
+    }
+    return true;
+}
+
+void laproque::RingBuffer::_store( const float* input, unsigned long n_frames, char* dest )
+{
+    unsigned long idx = 0;
+    
+    switch ( _format ) {
+        case FLOAT32:
+            std::memcpy( dest, input, n_frames*sizeof(float) );
+            break;
+            
+        case FLOAT16:
+            if ( has_f16c ) {
+                store_half_f16c( input, n_frames, (uint16_t*)dest );
+            }
+            else {
+                for ( ; idx < n_frames; idx++ ) {
+                    ((uint16_t*)dest)[idx] = float_to_half( input[idx] );
+                }
+            }
+            break;
+            
+        case INT16:
+        {
+            // Clip before converting. Out of range values would convert to the integer minimum.
+            const __m128 scale = _mm_set1_ps( INT16_SCALE );
+            const __m128 lowest = _mm_set1_ps( -32768.f );
+            const __m128 highest = _mm_set1_ps( 32767.f );
+            int16_t* samples = (int16_t*)dest;
+            for ( ; idx + 8 <= n_frames; idx += 8 ) {
+                __m128 low_values = _mm_mul_ps( _mm_loadu_ps( input + idx ), scale );
+                __m128 high_values = _mm_mul_ps( _mm_loadu_ps( input + idx + 4 ), scale );
+                __m128i low = _mm_cvtps_epi32( _mm_max_ps( _mm_min_ps( low_values, highest ), lowest ) );
+                __m128i high = _mm_cvtps_epi32( _mm_max_ps( _mm_min_ps( high_values, highest ), lowest ) );
+                _mm_storeu_si128( (__m128i*)(samples + idx), _mm_packs_epi32( low, high ) );
+            }
+            for ( ; idx < n_frames; idx++ ) {
+                float value = std::min( std::max( input[idx] * INT16_SCALE, -32768.f ), 32767.f );
+                samples[idx] = int16_t( lrintf( value ) );
+            }
+            break;
+        }
+    }
+}
+
+void laproque::RingBuffer::_load( const char* source, unsigned long n_frames, float* output )
+{
+    unsigned long idx = 0;
+    
+    switch ( _format ) {
+        case FLOAT32:
+            std::memcpy( output, source, n_frames*sizeof(float) );
+            break;
+            
+        case FLOAT16:
+            if ( has_f16c ) {
+                load_half_f16c( (const uint16_t*)source, n_frames, output );
+            }
+            else {
+                for ( ; idx < n_frames; idx++ ) {
+                    output[idx] = half_to_float( ((const uint16_t*)source)[idx] );
+                }
+            }
+            break;
+            
+        case INT16:
+        {
+            const __m128 scale = _mm_set1_ps( 1.f / INT16_SCALE );
+            const int16_t* samples = (const int16_t*)source;
+            for ( ; idx + 8 <= n_frames; idx += 8 ) {
+                __m128i values = _mm_loadu_si128( (const __m128i*)(samples + idx) );
+                
+                // Sign extend to 32 bit.
+                __m128i low = _mm_srai_epi32( _mm_unpacklo_epi16( values, values ), 16 );
+                __m128i high = _mm_srai_epi32( _mm_unpackhi_epi16( values, values ), 16 );
+                _mm_storeu_ps( output + idx, _mm_mul_ps( _mm_cvtepi32_ps( low ), scale ) );
+                _mm_storeu_ps( output + idx + 4, _mm_mul_ps( _mm_cvtepi32_ps( high ), scale ) );
+            }
+            for ( ; idx < n_frames; idx++ ) {
+                output[idx] = float(samples[idx]) * (1.f / INT16_SCALE);
+            }
+            break;
+        }
+    }
+}
+
+void laproque::RingBuffer::write( const float* input, unsigned long n_frames )
+{
+    while ( n_frames ) {
+        unsigned long page = _pos >> _page_shift;
+        unsigned long offset = _pos & _page_mask;
+        unsigned long n_ready = std::min( n_frames, _page_size - offset );
+        
+        // Everything in a page the writer enters has expired.
+        if ( _pool && offset == 0 ) {
+            _release( page );
+        }
+        
+        bool silent = _pool && _is_silent( input, n_ready );
+        
+        // Silence needs no page, not acquired pages read as 0.
+        if ( ( !silent || _is_acquired( page ) ) && _get_writable( page ) ) {
+            _store( input, n_ready, _sample_address( page, offset ) );
+        }
+        
+        // Keep the mirror behind the previous page up to date with the start of this one.
+        if ( offset < _max_block ) {
+            unsigned long previous = (page - 1) & (_n_pages - 1);
+            unsigned long n_mirror = std::min( n_ready, _max_block - offset );
+            
+            if ( ( !silent || _is_acquired( previous ) ) && _get_writable( previous ) ) {
+                _store( input, n_mirror, _sample_address( previous, _page_size + offset ) );
+            }
+        }
+        
+        input += n_ready;
+        n_frames -= n_ready;
+        _pos = (_pos + n_ready) & _mask;
+    }
+}
+
+void laproque::RingBuffer::replace( const float* input, unsigned long n_frames )
+{
+    _pos = (_pos - n_frames) & _mask;
+    write( input, n_frames );
+}
+
+const char* laproque::RingBuffer::_block_address( unsigned long delay, unsigned long n_frames )
+{
+    unsigned long start = (_pos - n_frames - delay) & _mask;
+    return _sample_address( start >> _page_shift, start & _page_mask );
+}
+
+unsigned laproque::RingBuffer::get_spans( unsigned long delay, unsigned long n_frames, const float** spans, unsigned long* lengths )
+{
+    // The page the writer is in holds no valid history in a paged buffer.
+    unsigned long n_valid = _pool ? _size - _page_size : _size;
+    if ( _format != FLOAT32 || n_frames + delay > n_valid ) return 0;
+    
+    unsigned long start = (_pos - n_frames - delay) & _mask;
+    unsigned long page = start >> _page_shift;
+    unsigned long offset = start & _page_mask;
+    
+    // The mirror extends the first piece beyond the end of its page.
+    spans[0] = _pages[page] + offset;
+    lengths[0] = std::min( n_frames, _page_size + _max_block - offset );
+    if ( lengths[0] == n_frames ) return 1;
+    
+    // Continue in the following page.
+    unsigned long next = ((start + lengths[0]) & _mask);
+    spans[1] = _pages[next >> _page_shift] + (next & _page_mask);
+    lengths[1] = n_frames - lengths[0];
+    
+    if ( (next & _page_mask) + lengths[1] > _page_size + _max_block ) return 0;
+    return 2;
+}
+
+unsigned long laproque::RingBuffer::get_max_span()
+{
+    return _pool ? _page_size + _max_block : _size;
+}
+
+void laproque::RingBuffer::read_block( unsigned long delay, unsigned long n_frames, float* output )
+{
+    _load( _block_address( delay, n_frames ), n_frames, output );
+}
+
+void laproque::RingBuffer::add_block( unsigned long delay, unsigned long n_frames, float weight, float* output )
+{
+    unsigned long idx;
+    
+    if ( _format == FLOAT32 ) {
+        const float* samples = get_block( delay, n_frames );
+        for ( idx = 0; idx < n_frames; idx++ ) {
+            output[idx] += samples[idx] * weight;
+        }
+        return;
+    }
+    
+    // Convert in pieces which stay in the cache.
+    const char* source = _block_address( delay, n_frames );
+    float samples[CONVERT_BLOCK];
+    
+    while ( n_frames ) {
+        unsigned long n_ready = std::min( n_frames, CONVERT_BLOCK );
+        _load( source, n_ready, samples );
+        
+        for ( idx = 0; idx < n_ready; idx++ ) {
+            output[idx] += samples[idx] * weight;
+        }
+        
+        source += n_ready * _sample_bytes;
+        output += n_ready;
+        n_frames -= n_ready;
+    }
+}
+
+void laproque::RingBuffer::add_block( unsigned long delay, unsigned long n_frames, const float* gains, float* output )
+{
+    unsigned long idx;
+    
+    if ( _format == FLOAT32 ) {
+        const float* samples = get_block( delay, n_frames );
+        for ( idx = 0; idx < n_frames; idx++ ) {
+            output[idx] += samples[idx] * gains[idx];
+        }
+        return;
+    }
+    
+    const char* source = _block_address( delay, n_frames );
+    float samples[CONVERT_BLOCK];
+    
+    while ( n_frames ) {
+        unsigned long n_ready = std::min( n_frames, CONVERT_BLOCK );
+        _load( source, n_ready, samples );
+        
+        for ( idx = 0; idx < n_ready; idx++ ) {
+            output[idx] += samples[idx] * gains[idx];
+        }
+        
+        source += n_ready * _sample_bytes;
+        gains += n_ready;
+        output += n_ready;
+        n_frames -= n_ready;
+    }
+}
+
+void laproque::RingBuffer::add_interpolated( float start_delay, float end_delay, float start_weight, float end_weight, unsigned long n_frames, float* output )
+{
+    float delay_step = (end_delay - start_delay) / float(n_frames);
+    float weight_step = (end_weight - start_weight) / float(n_frames);
+    
+    // Contiguous piece of history covering all positions of this block.
+    unsigned long low_delay = (unsigned long)(floorf( std::min( start_delay, end_delay ) )) - 2;
+    unsigned long high_delay = n_frames + (unsigned long)(ceilf( std::max( start_delay, end_delay ) )) + 2;
+    unsigned long span = high_delay - low_delay + 1;
+    const float* history = get_block( low_delay, span );
+    
+    // Frame idx reads history at offset + idx - delay.
+    float offset = float(span + low_delay) - float(n_frames);
+    
+    const __m128 frame_offsets = _mm_set_ps( 3.f, 2.f, 1.f, 0.f );
+    const __m128 half = _mm_set1_ps( 0.5f );
+    const __m128 one_and_half = _mm_set1_ps( 1.5f );
+    const __m128 two = _mm_set1_ps( 2.f );
+    const __m128 two_and_half = _mm_set1_ps( 2.5f );
+    
+    unsigned long idx = 0;
+    
+    for ( ; idx + 4 <= n_frames; idx += 4 ) {
+        __m128 frames = _mm_add_ps( _mm_set1_ps( float(idx) ), frame_offsets );
+        __m128 delays = _mm_add_ps( _mm_set1_ps( start_delay ), _mm_mul_ps( _mm_set1_ps( delay_step ), frames ) );
+        __m128 positions = _mm_sub_ps( _mm_add_ps( _mm_set1_ps( offset ), frames ), delays );
+        
+        __m128i int_positions = _mm_cvttps_epi32( positions );
+        __m128 frac = _mm_sub_ps( positions, _mm_cvtepi32_ps( int_positions ) );
+        
+        int pos[4];
+        _mm_storeu_si128( (__m128i*)pos, int_positions );
+        
+        // Four neighbouring samples of every frame, transposed to one vector per neighbour.
+        __m128 xm1 = _mm_loadu_ps( history + pos[0] - 1 );
+        __m128 x0 = _mm_loadu_ps( history + pos[1] - 1 );
+        __m128 x1 = _mm_loadu_ps( history + pos[2] - 1 );
+        __m128 x2 = _mm_loadu_ps( history + pos[3] - 1 );
+        _MM_TRANSPOSE4_PS( xm1, x0, x1, x2 );
+        
+        __m128 c1 = _mm_mul_ps( half, _mm_sub_ps( x1, xm1 ) );
+        __m128 c2 = _mm_add_ps( _mm_sub_ps( xm1, _mm_mul_ps( two_and_half, x0 ) ), _mm_sub_ps( _mm_mul_ps( two, x1 ), _mm_mul_ps( half, x2 ) ) );
+        __m128 c3 = _mm_add_ps( _mm_mul_ps( half, _mm_sub_ps( x2, xm1 ) ), _mm_mul_ps( one_and_half, _mm_sub_ps( x0, x1 ) ) );
+        
+        __m128 value = _mm_add_ps( _mm_mul_ps( c3, frac ), c2 );
+        value = _mm_add_ps( _mm_mul_ps( value, frac ), c1 );
+        value = _mm_add_ps( _mm_mul_ps( value, frac ), x0 );
+        
+        __m128 weights = _mm_add_ps( _mm_set1_ps( start_weight ), _mm_mul_ps( _mm_set1_ps( weight_step ), frames ) );
+        _mm_storeu_ps( output + idx, _mm_add_ps( _mm_loadu_ps( output + idx ), _mm_mul_ps( value, weights ) ) );
+    }
+    
+    for ( ; idx < n_frames; idx++ ) {
+        float position = offset + float(idx) - (start_delay + delay_step * float(idx));
+        long int_position = long(position);
+        
+        output[idx] += hermite( history + int_position, position - float(int_position) ) * (start_weight + weight_step * float(idx));
+    }
+}
+
+void laproque::RingBuffer::reset()
+{
+    if ( _pool ) {
+        for ( unsigned long page = 0; page < _n_pages; page++ ) {
+            _release( page );
+        }
+    }
+    else {
+        std::memset( _pages[0], 0, (_size + _max_block) * _sample_bytes );
+    }
+    _pos = 0;
+}
+
+unsigned long laproque::RingBuffer::get_size()
+{
+    return _size;
+}
+
+unsigned long laproque::RingBuffer::get_max_block()
+{
+    return _max_block;
+}
+
+unsigned long laproque::RingBuffer::get_n_pages_used()
+{
+    if ( !_pool ) return 1;
+    
+    unsigned long n_used = 0;
+    for ( unsigned long page = 0; page < _n_pages; page++ ) {
+        if ( _is_acquired( page ) ) n_used++;
+    }
+    return n_used;
+}
+
+laproque::sample_format laproque::RingBuffer::get_format()
+{
+    return _format;
+}
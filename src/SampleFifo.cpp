@@ -0,0 +1,92 @@
+//
+//  SampleFifo.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.
+//
+
+#include "SampleFifo.hpp"
+#include <algorithm>
+#include <cstring>
+
+laproque::SampleFifo::SampleFifo( unsigned long min_size )
+{
+    // Round up to the next power of two.
+    _size = 1;
+    while ( _size < min_size ) _size <<= 1;
+    _mask = _size - 1;
+
+    _buffer.resize( _size, 0.f );
+}
+
+unsigned long laproque::SampleFifo::write( const float* input, unsigned long n_frames )
+{
+    // Only this thread moves the write position. The reader may free more space meanwhile.
+    unsigned long long write_pos = _write_pos.load( std::memory_order_relaxed );
+    unsigned long long read_pos = _read_pos.load( std::memory_order_acquire );
+
+    n_frames = std::min( n_frames, _size - (unsigned long)( write_pos - read_pos ) );
+
+    unsigned long start = (unsigned long)( write_pos ) & _mask;
+    unsigned long first = std::min( n_frames, _size - start );
+    memcpy( &_buffer[start], input, first * sizeof(float) );
+    memcpy( &_buffer[0], input + first, (n_frames - first) * sizeof(float) );
+
+    _write_pos.store( write_pos + n_frames, std::memory_order_release );
+    return n_frames;
+}
+
+unsigned long laproque::SampleFifo::read( float* output, unsigned long n_frames )
+{
+    unsigned long long read_pos = _read_pos.load( std::memory_order_relaxed );
+    unsigned long long write_pos = _write_pos.load( std::memory_order_acquire );
+
+    n_frames = std::min( n_frames, (unsigned long)( write_pos - read_pos ) );
+
+    unsigned long start = (unsigned long)( read_pos ) & _mask;
+    unsigned long first = std::min( n_frames, _size - start );
+    memcpy( output, &_buffer[start], first * sizeof(float) );
+    memcpy( output + first, &_buffer[0], (n_frames - first) * sizeof(float) );
+
+    _read_pos.store( read_pos + n_frames, std::memory_order_release );
+    return n_frames;
+}
+
+void laproque::SampleFifo::skip_to( unsigned long long position )
+{
+    unsigned long long read_pos = _read_pos.load( std::memory_order_relaxed );
+    unsigned long long write_pos = _write_pos.load( std::memory_order_acquire );
+
+    position = std::min( position, write_pos );
+    if ( position > read_pos ) {
+        _read_pos.store( position, std::memory_order_release );
+    }
+}
+
+unsigned long laproque::SampleFifo::get_n_readable()
+{
+    // The older position first, so the difference never becomes negative.
+    unsigned long long read_pos = _read_pos.load( std::memory_order_acquire );
+    return (unsigned long)( _write_pos.load( std::memory_order_acquire ) - read_pos );
+}
+
+unsigned long laproque::SampleFifo::get_n_writable()
+{
+    return _size - get_n_readable();
+}
+
+unsigned long long laproque::SampleFifo::get_write_position()
+{
+    return _write_pos.load( std::memory_order_acquire );
+}
+
+unsigned long long laproque::SampleFifo::get_read_position()
+{
+    return _read_pos.load( std::memory_order_acquire );
+}
+
+unsigned long laproque::SampleFifo::get_size()
+{
+    return _size;
+}
@@ -91,7 +91,7 @@ void laproque::TimeVarConvolver::process( float *in_buffer, float *out_buffer )
     memcpy( _input, in_buffer, _block_size*sizeof(float) );
     
     // Shift the input spectrum buffer for next run.
-    memcpy( _input_spectra+_spectrum_size, _input_spectra, ( _spectra_size-_spectrum_size)*sizeof(fftwf_complex) );
+    memmove( _input_spectra+_spectrum_size, _input_spectra, ( _spectra_size-_spectrum_size)*sizeof(fftwf_complex) );
 }
 
 void laproque::TimeVarConvolver::set_partitions( fftwf_complex *new_partitions )
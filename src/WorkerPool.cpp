@@ -0,0 +1,124 @@
+//
+//  WorkerPool.cpp
+//  laproque - https://github.com/Buerner/laproque
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "WorkerPool.hpp"
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+
+laproque::WorkerPool::WorkerPool( unsigned n_workers, int priority )
+{
+    for ( unsigned worker = 1; worker < n_workers; worker++ ) {
+        _threads.push_back( std::thread( &WorkerPool::_work, this, worker ) );
+    }
+    
+    _inherit_scheduling = priority <= 0;
+    if ( !_inherit_scheduling ) _set_scheduling( SCHED_FIFO, priority );
+}
+
+laproque::WorkerPool::~WorkerPool()
+{
+    _quit.store( true );
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+    }
+    _job_started.notify_all();
+    
+    for ( unsigned idx = 0; idx < _threads.size(); idx++ ) {
+        _threads[idx].join();
+    }
+}
+
+void laproque::WorkerPool::run( void (*job)( void*, unsigned ), void* context )
+{
+    // Usually the audio thread only gets its real-time priority after the pool was built.
+    if ( _inherit_scheduling ) {
+        int policy;
+        sched_param param;
+        if ( pthread_getschedparam( pthread_self(), &policy, &param ) == 0 && policy != SCHED_OTHER ) {
+            _set_scheduling( policy, param.sched_priority );
+        }
+        _inherit_scheduling = false;
+    }
+    
+    _job = job;
+    _context = context;
+    
+    _n_busy.store( unsigned(_threads.size()) );
+    _generation.fetch_add( 1 );
+    
+    // A worker checks the generation under the mutex before it blocks, so passing the mutex
+    // once makes sure every sleeping worker either sees the new job or gets the notification.
+    if ( _n_sleeping.load() ) {
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+        }
+        _job_started.notify_all();
+    }
+    
+    job( context, 0 );
+    
+    // Wait for the other workers. Spin a while before giving the core away.
+    for ( unsigned n_spins = 0; _n_busy.load( std::memory_order_acquire ); n_spins++ ) {
+        if ( n_spins >= MAX_SPINS ) {
+            std::unique_lock<std::mutex> lock( _mutex );
+            _caller_sleeping.store( true );
+            while ( _n_busy.load() ) _job_done.wait( lock );
+            _caller_sleeping.store( false );
+            break;
+        }
+    }
+}
+
+void laproque::WorkerPool::_set_scheduling( int policy, int priority )
+{
+    sched_param param;
+    param.sched_priority = std::min( std::max( priority, sched_get_priority_min( policy ) ), sched_get_priority_max( policy ) );
+    
+    for ( unsigned idx = 0; idx < _threads.size(); idx++ ) {
+        pthread_setschedparam( _threads[idx].native_handle(), policy, &param );
+    }
+}
+
+unsigned laproque::WorkerPool::get_n_workers()
+{
+    return unsigned(_threads.size()) + 1;
+}
+
+void laproque::WorkerPool::_work( unsigned worker )
+{
+    unsigned done = 0;
+    unsigned generation;
+    
+    while ( true ) {
+        // Wait for the next job. Spin a while before blocking.
+        unsigned n_spins = 0;
+        while ( (generation = _generation.load( std::memory_order_acquire )) == done ) {
+            if ( _quit.load() ) return;
+            
+            if ( ++n_spins >= MAX_SPINS ) {
+                std::unique_lock<std::mutex> lock( _mutex );
+                _n_sleeping.fetch_add( 1 );
+                while ( _generation.load() == done && !_quit.load() ) _job_started.wait( lock );
+                _n_sleeping.fetch_sub( 1 );
+                n_spins = 0;
+            }
+        }
+        done = generation;
+        
+        _job( _context, worker );
+        
+        // The last worker wakes run() if it stopped spinning.
+        if ( _n_busy.fetch_sub( 1 ) == 1 && _caller_sleeping.load() ) {
+            {
+                std::lock_guard<std::mutex> lock( _mutex );
+            }
+            _job_done.notify_one();
+        }
+    }
+}